@@ -1,3 +1,6 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // SIGEV_THREAD_ID 等 Linux 扩展 (Python.h 会先定义好)
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,8 +9,40 @@
 #include <stdint.h> // 引入 uint8_t 这种标准类型
 
 #include <time.h>
+#include <math.h>
+#include <stdatomic.h>   // 声音回调和主线程之间的环形缓冲
+#include <libgen.h>      // dirname / basename
+#include <pthread.h>     // 启动时在后台线程加载 ROM
+#include <dirent.h>       // 扫描 ROM 目录 (启动器模式)
+#include <strings.h>      // strcasecmp
+#include <sys/stat.h>
+#include <sys/mman.h>    // ROM 打包文件整个映射进来
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/un.h>       // 服务模式的 Unix 域套接字
+#include <poll.h>
+#include <linux/io_uring.h> // 农场模式批量读写文件
+#include <sys/inotify.h> // 监视 ROM 文件变化 (热重载)
+#include <sys/socket.h>  // 联机用的 UDP
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <dlfcn.h>       // JIT: 加载编译好的 .so
+#include <signal.h>      // 采样分析器 (SIGPROF)
+#include <sys/syscall.h> // gettid
+#include <sys/wait.h>    // 农场的隔离模式 (一批任务一个子进程)
+#include <sys/file.h>    // flock (怪癖缓存文件)
 #include <SDL2/SDL.h> // 引入图形库
 
+// 推迟绘制的精灵：坐标 + 精灵数据的拷贝 (拷贝一份，之后内存被改了也不怕)
+typedef struct {
+    uint8_t x, y;     // VX, VY 的值 (还没取模)
+    uint8_t height;   // N
+    uint8_t rows[15]; // 精灵的每一行
+} PendingSprite;
+
+#define DISPLAY_LIST_SIZE 64
+
 typedef struct {
     // === 内存 ===
     // 对应书第 1.5 章
@@ -34,8 +69,12 @@ typedef struct {
     // === 倒计时器 ===
     // 对应书第 4 章 "定时器"
     // 只要这两个数大于 0，每秒钟就会自动减 60 次
-    uint8_t delay_timer;
-    uint8_t sound_timer; 
+    // 改成 "惰性" 的：不再每条指令都去减，而是记下 "在第几个周期减到 0"，
+    // 真要读的时候再用 cycles 算出当前值 (见 get_delay_timer)
+    uint64_t delay_expire;
+    uint64_t sound_expire;
+    uint64_t cycles;       // 已经执行了多少条指令 (定时器的时钟)
+    uint64_t cycle_limit;  // run_cycles 这一批最多跑到第几个周期，0 表示不限制 (也不做空转跳过)
 
     // === 堆栈 ===
     // 对应书第 5.1.2 章 "堆栈"
@@ -51,6 +90,39 @@ typedef struct {
     // 新增：只有需要画图时才刷新屏幕
     bool draw_flag;
 
+    // === 推迟绘制 (Display List) ===
+    // DXYN 之后如果 VF 马上就会被覆盖 (没人关心碰撞)，就先不画，
+    // 攒到帧结束或者有人要读 gfx 的时候一次性画完，见 flush_display_list
+    PendingSprite display_list[DISPLAY_LIST_SIZE];
+    int display_count;
+
+    // === 帧边界检测 ===
+    // CHIP-8 没有 "垂直同步"，只能猜：一串画图 (DXYN/00E0) 之后，
+    // 第一次设置延时定时器 (FX15) 或者开始空转等它 (FX07 循环)，就说明这一帧画完了
+    int draws_since_wait; // 上一个帧边界之后画了几次
+    bool frame_ready;     // 刚过了一个帧边界，前端可以交画面了 (前端负责清掉)
+
+    // === 加固模式 ===
+    // 没通过加载时安全检查 (verify_rom) 的 ROM，每条指令都做边界检查；
+    // 一旦越界就记下原因并停机 (只走时钟，不再执行)
+    bool hardened;
+    uint8_t fault; // CPU_FAULT_xxx，0 表示正常
+
+    // === 怪癖 (Quirks) ===
+    // 同一条指令在 COSMAC VIP / CHIP-48 / SUPER-CHIP 上的行为不一样，ROM 作者是照着哪台机器写的，
+    // 就得照哪台的来。QUIRK_xxx 的组合，0 就是这个模拟器原来的行为。
+    uint8_t quirks;
+    uint16_t rom_size;    // 加载的 ROM 多大 (判断 PC 有没有跑出 ROM)
+    uint32_t unknown_ops; // 执行过几次不认识的指令
+
+    bool eager_draw; // DXYN 一律马上画，不推迟 (记撤销日志的时候要一条一条记，见 journal_step)
+    bool quiet;      // 这个 CPU 不打印指令和停机信息 (怪癖比赛的线程用；不去动全局的 cpu_log)
+
+    // === 随机数 ===
+    // 每个 CPU 自己的随机数状态 (CXNN 用)，不用全局的 rand()：
+    // 这样存档/读档、联机回滚重算的时候，随机数也能一模一样地重现
+    uint32_t rng;
+
 } Chip8;
 
 uint8_t keymap[16] = {
@@ -60,6 +132,70 @@ uint8_t keymap[16] = {
     SDLK_4, SDLK_r, SDLK_f, SDLK_v   // C, D, E, F
 };
 
+// 新增：CPU 执行日志开关
+// 每条指令都 printf 非常慢，同时跑很多个实例的时候要关掉
+bool cpu_log = true;
+bool rom_log = true; // 加载 ROM 时打印检查结果 (农场模式一次加载几万个，关掉)
+
+// 怪癖开关。每一位选的是 "另一种" 行为，清零的时候就是原来的样子
+enum {
+    QUIRK_SHIFT = 1,      // 8XY6/8XYE 移 VX 自己 (SUPER-CHIP)，不设是把 VY 移了放进 VX (COSMAC)
+    QUIRK_LOAD_STORE = 2, // FX55/FX65 之后 I 不变 (SUPER-CHIP)，不设是 I += X + 1 (COSMAC)
+    QUIRK_VF_RESET = 4,   // 8XY1/8XY2/8XY3 之后 VF 清零 (COSMAC)
+    QUIRK_JUMP = 8,       // BXNN 跳到 XNN + VX (SUPER-CHIP)，不设是 NNN + V0
+    QUIRK_EDGE = 16,      // 精灵画到边上就截掉 (COSMAC / SUPER-CHIP)，不设是绕到另一边
+};
+#define QUIRK_COUNT 5
+const char *quirk_names[QUIRK_COUNT] = { "shift", "load_store", "vf_reset", "jump", "edge" };
+
+// 几台常见机器的整套怪癖 (--quirks NAME)
+typedef struct {
+    const char *name;
+    uint8_t quirks;
+} QuirkProfile;
+
+const QuirkProfile quirk_profiles[] = {
+    { "default", 0 },
+    { "chip8",   QUIRK_VF_RESET | QUIRK_EDGE },
+    { "schip",   QUIRK_SHIFT | QUIRK_LOAD_STORE | QUIRK_JUMP | QUIRK_EDGE },
+    { "xochip",  0 },
+};
+
+// --quirks 选的怪癖 (init_cpu 用)；auto_quirks 表示加载 ROM 之后自己猜，见 quirks_detect
+uint8_t forced_quirks = 0;
+bool auto_quirks = false;
+
+// 把怪癖写成 "shift,edge" 这样，没有就是 "none"
+void quirks_format(uint8_t quirks, char *out, size_t len) {
+    size_t used = 0;
+    out[0] = '\0';
+    for (int q = 0; q < QUIRK_COUNT; ++q) {
+        if ((quirks & (1 << q)) && used < len) {
+            used += snprintf(out + used, len - used, "%s%s", used ? "," : "", quirk_names[q]);
+        }
+    }
+    if (used == 0) snprintf(out, len, "none");
+}
+
+// --quirks 的参数：auto、机器名 (quirk_profiles)，或者直接给 16 进制的 QUIRK_xxx 组合
+bool quirks_parse(const char *text) {
+    if (strcmp(text, "auto") == 0) {
+        auto_quirks = true;
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(quirk_profiles) / sizeof(quirk_profiles[0]); ++i) {
+        if (strcmp(text, quirk_profiles[i].name) == 0) {
+            forced_quirks = quirk_profiles[i].quirks;
+            return true;
+        }
+    }
+    char *end;
+    unsigned long q = strtoul(text, &end, 16);
+    if (*text == '\0' || *end != '\0' || q >= (1u << QUIRK_COUNT)) return false;
+    forced_quirks = (uint8_t)q;
+    return true;
+}
+
 // 2. 初始化函数 (给 CPU 通电复位)
 void init_cpu(Chip8 *cpu) {
     // PC 起始位置设为 0x200 (512)，因为前 512 字节是留空的
@@ -67,6 +203,21 @@ void init_cpu(Chip8 *cpu) {
     cpu->I = 0;
     cpu->sp = 0;
     cpu->draw_flag = true;
+    cpu->delay_expire = 0;
+    cpu->sound_expire = 0;
+    cpu->cycles = 0;
+    cpu->cycle_limit = 0;
+    cpu->display_count = 0;
+    cpu->draws_since_wait = 0;
+    cpu->frame_ready = false;
+    cpu->rng = (uint32_t)rand() | 1; // xorshift 的状态不能是 0
+    cpu->hardened = true; // 还没检查过，先当作不可信
+    cpu->fault = 0;
+    cpu->quirks = forced_quirks;
+    cpu->rom_size = 0;
+    cpu->unknown_ops = 0;
+    cpu->eager_draw = false;
+    cpu->quiet = false;
     // 清空内存、寄存器、显存 (全部填 0)
     // memset 是 C 语言最快的清零方法：(目标地址, 填什么数, 填多长)
     memset(cpu->memory, 0, sizeof(cpu->memory));
@@ -75,10 +226,595 @@ void init_cpu(Chip8 *cpu) {
     memset(cpu->stack, 0, sizeof(cpu->stack));
     memset(cpu->key, 0, sizeof(cpu->key));
 }
+// 加固模式下的各种错误
+enum { CPU_OK, CPU_FAULT_PC, CPU_FAULT_STACK_OVERFLOW, CPU_FAULT_STACK_UNDERFLOW, CPU_FAULT_KEY, CPU_FAULT_MEMORY };
+const char *fault_names[] = { "ok", "PC out of memory", "stack overflow", "stack underflow", "key index > 0xF", "memory access out of range" };
+
+void cpu_fault(Chip8 *cpu, uint8_t fault) {
+    cpu->fault = fault;
+    if ((cpu_log || rom_log) && !cpu->quiet) printf("CPU fault: %s at pc=0x%03X, halted\n", fault_names[fault], cpu->pc);
+}
+
+// xorshift32：又快又简单，结果只取决于 cpu->rng
+uint32_t cpu_rand(Chip8 *cpu) {
+    uint32_t r = cpu->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    cpu->rng = r;
+    return r;
+}
+
+// 机器状态的指纹 (FNV-1a)，用来比较两台机器是不是跑到了一样的状态。
+// 只算真正的状态，不碰结构体里的填充字节
+uint32_t fnv1a(uint32_t h, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+uint32_t cpu_state_hash(const Chip8 *cpu) {
+    uint32_t h = 2166136261u;
+    h = fnv1a(h, cpu->memory, sizeof(cpu->memory));
+    h = fnv1a(h, cpu->V, sizeof(cpu->V));
+    h = fnv1a(h, &cpu->I, sizeof(cpu->I));
+    h = fnv1a(h, &cpu->pc, sizeof(cpu->pc));
+    h = fnv1a(h, cpu->gfx, sizeof(cpu->gfx));
+    h = fnv1a(h, &cpu->delay_expire, sizeof(cpu->delay_expire));
+    h = fnv1a(h, &cpu->sound_expire, sizeof(cpu->sound_expire));
+    h = fnv1a(h, &cpu->cycles, sizeof(cpu->cycles));
+    h = fnv1a(h, cpu->stack, sizeof(cpu->stack));
+    h = fnv1a(h, &cpu->sp, sizeof(cpu->sp));
+    h = fnv1a(h, &cpu->rng, sizeof(cpu->rng));
+    return h;
+}
+
+// === 新增：惰性定时器 ===
+// 现在的定时器是每条指令减 1，所以 "当前值" = 到期周期 - 当前周期
+uint8_t get_delay_timer(const Chip8 *cpu) {
+    return cpu->delay_expire > cpu->cycles ? (uint8_t)(cpu->delay_expire - cpu->cycles) : 0;
+}
+
+uint8_t get_sound_timer(const Chip8 *cpu) {
+    return cpu->sound_expire > cpu->cycles ? (uint8_t)(cpu->sound_expire - cpu->cycles) : 0;
+}
+
+// 写入发生在这条指令里，指令结束时 cycles 才加 1，
+// 所以效果和以前 "设成 v，指令结束时减 1" 完全一样
+void set_delay_timer(Chip8 *cpu, uint8_t v) {
+    cpu->delay_expire = cpu->cycles + v;
+}
+
+void set_sound_timer(Chip8 *cpu, uint8_t v) {
+    cpu->sound_expire = cpu->cycles + v;
+}
+
+// === 新增：ROM 安全检查 (Verifier) ===
+// 加载的时候把 ROM 从 0x200 开始能走到的所有路径都走一遍 (不真的执行，只看指令)，
+// 证明下面这些事永远不会发生：
+//   - 调用超过 16 层 / 栈是空的时候 00EE
+//   - DXYN 从 I 开始读精灵读出 4KB 以外 (I 只能来自 ANNN 的常量)
+//   - EX9E/EXA1 用 V[x] 当按键下标，但 V[x] 可能 > 15
+//   - FX33/FX55 往代码上写 (自修改代码)，FX65 读出 4KB
+//   - PC 跑出 4KB (BNNN 算出来的地址没法证明，直接不过)
+// 证明成功的 ROM 跑不带检查的快速核心，否则跑加了边界检查的 "加固" 核心 (见 emulate_cycle)。
+// 注意这里模拟的是 "这个" 模拟器的语义 (包括当前的怪癖)：没实现的指令就是什么都不做，往下走。
+#define VERIFY_MAX_STATES (1 << 16)
+#define I_UNKNOWN 0xFFFF
+
+// 分析时的抽象状态：PC + I 的常量值 + 调用栈
+typedef struct {
+    uint16_t pc;
+    uint16_t I;
+    uint8_t depth;
+    uint16_t stack[16];
+} VState;
+
+typedef struct {
+    VState *seen;  // 开放寻址的哈希表
+    uint32_t *gen; // gen[i] != cur 表示空位，这样每次检查不用把整张表清一遍 (几 MB)
+    uint32_t cur;
+    int capacity;
+    int count;
+} VSeen;
+
+uint32_t vstate_hash(const VState *s) {
+    uint32_t h = 2166136261u;
+    h = fnv1a(h, &s->pc, sizeof(s->pc));
+    h = fnv1a(h, &s->I, sizeof(s->I));
+    h = fnv1a(h, &s->depth, sizeof(s->depth));
+    return fnv1a(h, s->stack, s->depth * sizeof(uint16_t));
+}
+
+bool vstate_equal(const VState *a, const VState *b) {
+    return a->pc == b->pc && a->I == b->I && a->depth == b->depth &&
+           memcmp(a->stack, b->stack, a->depth * sizeof(uint16_t)) == 0;
+}
+
+// 第一次见到返回 true
+bool vseen_insert(VSeen *t, const VState *s) {
+    uint32_t i = vstate_hash(s) & (t->capacity - 1);
+    while (t->gen[i] == t->cur) {
+        if (vstate_equal(&t->seen[i], s)) return false;
+        i = (i + 1) & (t->capacity - 1);
+    }
+    t->seen[i] = *s;
+    t->gen[i] = t->cur;
+    t->count++;
+    return true;
+}
+
+bool verify_rom(const Chip8 *cpu, char *why, size_t why_len, int *max_depth) {
+    static _Thread_local uint8_t reach[4096];     // 哪些字节是会被执行的代码
+    static _Thread_local uint8_t jumped_to[4096]; // 这条指令是不是跳转/跳过/返回的目标 (不只是顺着走过来)
+    static _Thread_local uint8_t insn_start[4096]; // 会被当成指令开头的地址
+    memset(reach, 0, sizeof(reach));
+    memset(insn_start, 0, sizeof(insn_start));
+    memset(jumped_to, 0, sizeof(jumped_to));
+
+    // 表很大，每个线程分配一次一直留着；加载一大堆 ROM 的时候不用每次都 malloc/清零
+    static _Thread_local VSeen seen;
+    static _Thread_local VState *work;
+    if (seen.seen == NULL) {
+        seen.capacity = 2 * VERIFY_MAX_STATES;
+        seen.seen = malloc(seen.capacity * sizeof(VState));
+        seen.gen = calloc(seen.capacity, sizeof(uint32_t));
+        work = malloc(VERIFY_MAX_STATES * sizeof(VState));
+    }
+    seen.cur++;
+    seen.count = 0;
+    // 往代码里写的指令：[start, start+len)
+    uint16_t store_start[256], store_len[256];
+    int nstores = 0;
+    bool ok = false;
+    *max_depth = 0;
+
+    if (seen.seen == NULL || seen.gen == NULL || work == NULL) {
+        snprintf(why, why_len, "out of memory");
+        goto done;
+    }
+
+    int nwork = 0;
+    work[nwork++] = (VState){ .pc = cpu->pc, .I = cpu->I, .depth = 0 };
+
+// 把一个后继状态放进工作表；jump 表示不是顺着走到的
+#define VERIFY_PUSH(state, is_jump) do {                                  \
+        if (nwork == VERIFY_MAX_STATES) {                                  \
+            snprintf(why, why_len, "too many states");                    \
+            goto done;                                                     \
+        }                                                                  \
+        work[nwork] = (state);                                             \
+        if ((is_jump) && work[nwork].pc < 4096) jumped_to[work[nwork].pc] = 1; \
+        nwork++;                                                           \
+    } while (0)
+
+    while (nwork > 0) {
+        VState s = work[--nwork];
+        if (!vseen_insert(&seen, &s)) continue;
+        if (seen.count >= VERIFY_MAX_STATES) {
+            snprintf(why, why_len, "too many states");
+            goto done;
+        }
+        if (s.pc + 1 >= 4096) {
+            snprintf(why, why_len, "PC can leave memory (0x%X)", s.pc);
+            goto done;
+        }
+        reach[s.pc] = reach[s.pc + 1] = 1;
+        insn_start[s.pc] = 1;
+
+        uint16_t op = (cpu->memory[s.pc] << 8) | cpu->memory[s.pc + 1];
+        uint8_t x = (op & 0x0F00) >> 8;
+        VState next = s;
+        next.pc = s.pc + 2;
+
+        switch (op & 0xF000) {
+            case 0x0000:
+                if (op == 0x00EE) {
+                    if (s.depth == 0) {
+                        snprintf(why, why_len, "00EE with empty stack at 0x%03X", s.pc);
+                        goto done;
+                    }
+                    next.depth--;
+                    next.pc = s.stack[next.depth] + 2;
+                    VERIFY_PUSH(next, true);
+                } else {
+                    VERIFY_PUSH(next, false);
+                }
+                break;
+            case 0x1000:
+                next.pc = op & 0x0FFF;
+                VERIFY_PUSH(next, true);
+                break;
+            case 0x2000:
+                if (s.depth == 16) {
+                    snprintf(why, why_len, "stack overflow at 0x%03X", s.pc);
+                    goto done;
+                }
+                next.stack[next.depth++] = s.pc;
+                if (next.depth > *max_depth) *max_depth = next.depth;
+                next.pc = op & 0x0FFF;
+                VERIFY_PUSH(next, true);
+                break;
+            case 0x3000:
+            case 0x4000:
+                VERIFY_PUSH(next, false);
+                next.pc = s.pc + 4;
+                VERIFY_PUSH(next, true);
+                break;
+            case 0xA000:
+                next.I = op & 0x0FFF;
+                VERIFY_PUSH(next, false);
+                break;
+            case 0xD000:
+                if (s.I == I_UNKNOWN || s.I + (op & 0x000F) > 4096) {
+                    snprintf(why, why_len, "sprite read out of range at 0x%03X", s.pc);
+                    goto done;
+                }
+                VERIFY_PUSH(next, false);
+                break;
+            case 0xE000:
+                if ((op & 0x00FF) == 0x9E || (op & 0x00FF) == 0xA1) {
+                    VERIFY_PUSH(next, false);
+                    next.pc = s.pc + 4;
+                    VERIFY_PUSH(next, true);
+                } else {
+                    VERIFY_PUSH(next, false);
+                }
+                break;
+            case 0xB000:
+                snprintf(why, why_len, "indirect jump at 0x%03X", s.pc);
+                goto done;
+            case 0xF000:
+                if ((op & 0x00FF) == 0x33 || (op & 0x00FF) == 0x55) {
+                    if (s.I == I_UNKNOWN || nstores == 256) {
+                        snprintf(why, why_len, "store through unknown I at 0x%03X", s.pc);
+                        goto done;
+                    }
+                    store_start[nstores] = s.I;
+                    store_len[nstores++] = ((op & 0x00FF) == 0x33) ? 3 : x + 1;
+                }
+                if ((op & 0x00FF) == 0x65 && (s.I == I_UNKNOWN || s.I + x >= 4096)) {
+                    snprintf(why, why_len, "load through unknown I at 0x%03X", s.pc);
+                    goto done;
+                }
+                // 之后 I 是多少要看 QUIRK_LOAD_STORE (所以换了怪癖要重新检查，见 cpu_verify)
+                if (((op & 0x00FF) == 0x55 || (op & 0x00FF) == 0x65) && !(cpu->quirks & QUIRK_LOAD_STORE)) {
+                    next.I = s.I + x + 1;
+                }
+                VERIFY_PUSH(next, false);
+                break;
+            default:
+                // 6/7/8/C 和没实现的指令：只改寄存器 (或者什么都不做)，顺着往下走
+                VERIFY_PUSH(next, false);
+                break;
+        }
+    }
+#undef VERIFY_PUSH
+
+    // 按键下标：只认 "6XNN (NN<=F) 紧挨着 EX9E/EXA1，而且 EX 这条只能从 6XNN 顺着走到" 的写法
+    for (int a = 0; a + 1 < 4096; a += 1) {
+        if (!insn_start[a] || (cpu->memory[a] & 0xF0) != 0xE0) continue;
+        uint8_t low = cpu->memory[a + 1];
+        if (low != 0x9E && low != 0xA1) continue;
+
+        uint8_t x = cpu->memory[a] & 0x0F;
+        bool const_key = a >= 2 && !jumped_to[a] && insn_start[a - 2] &&
+                         cpu->memory[a - 2] == (0x60 | x) && cpu->memory[a - 1] <= 0x0F;
+        if (!const_key) {
+            snprintf(why, why_len, "key index V%X not provably <= 0xF at 0x%03X", x, a);
+            goto done;
+        }
+    }
+
+    // 自修改代码：写的范围不能碰到任何会执行的字节
+    for (int i = 0; i < nstores; ++i) {
+        for (int b = store_start[i]; b < store_start[i] + store_len[i]; ++b) {
+            if (b >= 4096 || reach[b]) {
+                snprintf(why, why_len, "store at 0x%03X hits code or leaves memory", store_start[i]);
+                goto done;
+            }
+        }
+    }
+
+    ok = true;
+done:
+    return ok;
+}
+
+// === 新增：ROM 打包文件 (.c8pk) ===
+// 几万个小 .ch8 一个个 fopen/fread 太慢，打成一个包：
+//   PackHeader | PackEntry[count] (按名字排好) | uint32_t by_hash[count] (按哈希排好的下标) | ROM 数据...
+// 整个文件 mmap 一次，按名字或按哈希二分查找，ROM 数据直接从映射里拷进内存。
+// 用法：./chip8 --pack ROM目录 out.c8pk 打包；加载时写 "out.c8pk:pong.ch8" 或 "out.c8pk:#1A2B3C4D"，
+// 只写 "out.c8pk" 就是包里所有的 ROM (启动器 / 无界面模式)。
+#define PACK_MAGIC "C8PK"
+#define PACK_VERSION 1
+#define PACK_NAME_LEN 52
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t hash_index;  // by_hash 数组在文件里的偏移
+} PackHeader;
+
+typedef struct {
+    uint32_t hash;        // ROM 内容的 FNV-1a
+    uint32_t offset;      // ROM 数据在文件里的偏移
+    uint32_t size;
+    char name[PACK_NAME_LEN]; // 文件名 (不带目录)，'\0' 结尾
+} PackEntry;              // 64 字节
+
+typedef struct {
+    char path[4096];
+    const uint8_t *base;  // mmap 出来的整个文件
+    size_t size;
+    const PackHeader *header;
+    const PackEntry *entries;
+    const uint32_t *by_hash;
+} Pack;
+
+uint32_t rom_hash(const uint8_t *data, size_t size) {
+    return fnv1a(2166136261u, data, size);
+}
+
+bool pack_open(Pack *p, const char *path) {
+    memset(p, 0, sizeof(*p));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PackHeader)) {
+        close(fd);
+        return false;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // 映射建好就不需要 fd 了
+    if (base == MAP_FAILED) return false;
+
+    p->base = base;
+    p->size = st.st_size;
+    p->header = base;
+    p->entries = (const PackEntry *)(p->base + sizeof(PackHeader));
+    p->by_hash = (const uint32_t *)(p->base + p->header->hash_index);
+
+    // 检查文件头和每一项都落在文件里面，坏文件不要读越界
+    const PackHeader *h = p->header;
+    bool ok = memcmp(h->magic, PACK_MAGIC, 4) == 0 && h->version == PACK_VERSION &&
+              sizeof(PackHeader) + (uint64_t)h->count * sizeof(PackEntry) <= h->hash_index &&
+              h->hash_index + (uint64_t)h->count * sizeof(uint32_t) <= p->size;
+    for (uint32_t i = 0; ok && i < h->count; ++i) {
+        const PackEntry *e = &p->entries[i];
+        ok = (uint64_t)e->offset + e->size <= p->size && p->by_hash[i] < h->count &&
+             memchr(e->name, '\0', PACK_NAME_LEN) != NULL;
+    }
+    if (!ok) {
+        munmap(base, p->size);
+        p->base = NULL;
+        return false;
+    }
+    snprintf(p->path, sizeof(p->path), "%s", path);
+    return true;
+}
+
+void pack_close(Pack *p) {
+    if (p->base != NULL) munmap((void *)p->base, p->size);
+    p->base = NULL;
+}
+
+// 按名字二分查找，找不到返回 NULL
+const PackEntry *pack_find_name(const Pack *p, const char *name) {
+    int lo = 0, hi = (int)p->header->count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int c = strcmp(p->entries[mid].name, name);
+        if (c == 0) return &p->entries[mid];
+        if (c < 0) lo = mid + 1; else hi = mid - 1;
+    }
+    return NULL;
+}
+
+const PackEntry *pack_find_hash(const Pack *p, uint32_t hash) {
+    int lo = 0, hi = (int)p->header->count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        uint32_t h = p->entries[p->by_hash[mid]].hash;
+        if (h == hash) return &p->entries[p->by_hash[mid]];
+        if (h < hash) lo = mid + 1; else hi = mid - 1;
+    }
+    return NULL;
+}
+
+// 同一个包只 mmap 一次。打开过的包一直留到进程结束，不换出去：
+// 别的线程 / 启动器的槽位手里的 Pack 指针和 ROM 数据就一直有效 (包一般就那么一两个)
+typedef struct PackCached {
+    Pack pack;
+    struct PackCached *next;
+} PackCached;
+
+Pack *pack_get(const char *path) {
+    static PackCached *cached = NULL;
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&lock);
+    PackCached *c = cached;
+    while (c != NULL && strcmp(c->pack.path, path) != 0) c = c->next;
+    if (c == NULL) {
+        c = malloc(sizeof(PackCached));
+        if (c != NULL && pack_open(&c->pack, path)) {
+            c->next = cached;
+            cached = c;
+        } else {
+            free(c);
+            c = NULL;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return c != NULL ? &c->pack : NULL;
+}
+
+// "xxx.c8pk:名字" / "xxx.c8pk:#哈希" -> 包里的一项；不是包里的 ROM (或者找不到) 返回 NULL
+const PackEntry *pack_resolve(const char *spec, const Pack **out_pack) {
+    const char *sep = strstr(spec, ".c8pk:");
+    if (sep == NULL) return NULL;
+    char path[4096];
+    snprintf(path, sizeof(path), "%.*s", (int)(sep + 5 - spec), spec);
+    const Pack *p = pack_get(path);
+    if (p == NULL) return NULL;
+    *out_pack = p;
+    const char *key = sep + 6;
+    if (key[0] == '#') return pack_find_hash(p, (uint32_t)strtoul(key + 1, NULL, 16));
+    return pack_find_name(p, key);
+}
+
+int compare_pack_names(const void *a, const void *b) {
+    return strcmp(((const PackEntry *)a)->name, ((const PackEntry *)b)->name);
+}
+
+const PackEntry *sort_entries; // qsort 没有用户参数，按哈希排下标的时候用
+int compare_pack_hashes(const void *a, const void *b) {
+    uint32_t ha = sort_entries[*(const uint32_t *)a].hash;
+    uint32_t hb = sort_entries[*(const uint32_t *)b].hash;
+    return (ha > hb) - (ha < hb);
+}
+
+// 打包：把目录里所有 .ch8 写进 out。返回打了几个，失败返回 -1
+int pack_build(const char *dir, const char *out) {
+    DIR *d = opendir(dir);
+    if (d == NULL) return -1;
+
+    int count = 0, capacity = 0;
+    PackEntry *entries = NULL;
+    uint8_t *data = NULL;
+    size_t data_size = 0, data_cap = 0;
+    bool failed = false;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        size_t n = strlen(ent->d_name);
+        if (n < 4 || strcasecmp(ent->d_name + n - 4, ".ch8") != 0) continue;
+        if (n >= PACK_NAME_LEN) {
+            printf("Skipping (name too long): %s\n", ent->d_name);
+            continue;
+        }
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        FILE *f = fopen(path, "rb");
+        if (f == NULL) continue;
+        uint8_t rom[4096 - 512];
+        size_t size = fread(rom, 1, sizeof(rom), f);
+        bool too_big = fgetc(f) != EOF;
+        fclose(f);
+        if (too_big) {
+            printf("Skipping (too big): %s\n", path);
+            continue;
+        }
+
+        if (count == capacity) {
+            int bigger_cap = capacity ? capacity * 2 : 256;
+            PackEntry *bigger = realloc(entries, bigger_cap * sizeof(PackEntry));
+            if (bigger == NULL) {
+                failed = true;
+                break;
+            }
+            entries = bigger;
+            capacity = bigger_cap;
+        }
+        if (data_size + size > data_cap) {
+            size_t bigger_cap = (data_cap ? data_cap * 2 : 65536) + size;
+            uint8_t *bigger = realloc(data, bigger_cap);
+            if (bigger == NULL) {
+                failed = true;
+                break;
+            }
+            data = bigger;
+            data_cap = bigger_cap;
+        }
+        PackEntry *e = &entries[count++];
+        memset(e, 0, sizeof(*e));
+        memcpy(e->name, ent->d_name, n);
+        e->hash = rom_hash(rom, size);
+        e->offset = (uint32_t)data_size; // 先记相对数据区的偏移，写文件前再加上头的大小
+        e->size = (uint32_t)size;
+        memcpy(data + data_size, rom, size);
+        data_size += size;
+    }
+    closedir(d);
+    if (failed) {
+        free(entries);
+        free(data);
+        return -1;
+    }
+
+    qsort(entries, count, sizeof(PackEntry), compare_pack_names);
+    uint32_t *by_hash = malloc((size_t)(count > 0 ? count : 1) * sizeof(uint32_t));
+    if (by_hash == NULL) {
+        free(entries);
+        free(data);
+        return -1;
+    }
+    for (int i = 0; i < count; ++i) by_hash[i] = i;
+    sort_entries = entries;
+    qsort(by_hash, count, sizeof(uint32_t), compare_pack_hashes);
+
+    PackHeader h = { .version = PACK_VERSION, .count = (uint32_t)count };
+    memcpy(h.magic, PACK_MAGIC, 4);
+    h.hash_index = sizeof(PackHeader) + count * sizeof(PackEntry);
+    uint32_t data_start = h.hash_index + count * sizeof(uint32_t);
+    for (int i = 0; i < count; ++i) entries[i].offset += data_start;
+
+    FILE *f = fopen(out, "wb");
+    bool ok = f != NULL &&
+              fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(entries, sizeof(PackEntry), count, f) == (size_t)count &&
+              fwrite(by_hash, sizeof(uint32_t), count, f) == (size_t)count &&
+              fwrite(data, 1, data_size, f) == data_size;
+    if (f != NULL && fclose(f) != 0) ok = false;
+    free(entries);
+    free(data);
+    free(by_hash);
+    return ok ? count : -1;
+}
+
 // === 新增：加载 ROM 函数 ===
+// 安全检查：过了就跑快速核心，不过就跑加固核心
+void cpu_verify(Chip8 *cpu) {
+    char why[128];
+    int depth;
+    cpu->hardened = !verify_rom(cpu, why, sizeof(why), &depth);
+    if (rom_log && cpu->hardened) {
+        printf("Verifier: %s -> hardened core\n", why);
+    } else if (rom_log) {
+        printf("Verifier: OK (max call depth %d) -> fast core\n", depth);
+    }
+}
+
+// 把内存里的一段 ROM 装进 0x200，并做安全检查 (文件和打包文件共用)
+bool load_rom_bytes(Chip8 *cpu, const uint8_t *data, long size) {
+    if (size > (4096 - 512)) {
+        printf("Error: ROM is too big!\n");
+        return false;
+    }
+    memcpy(&cpu->memory[0x200], data, size);
+    cpu->rom_size = (uint16_t)size;
+    cpu_verify(cpu);
+    return true;
+}
+
 bool load_rom(Chip8 *cpu, const char *filename) {
     printf("Loading: %s\n", filename);
 
+    // 0. 打包文件里的 ROM：直接从映射里拷
+    const Pack *pack = NULL;
+    const PackEntry *entry = pack_resolve(filename, &pack);
+    if (entry != NULL) {
+        printf("File size: %u bytes (packed, hash %08X)\n", entry->size, entry->hash);
+        return load_rom_bytes(cpu, pack->base + entry->offset, entry->size);
+    }
+    if (strstr(filename, ".c8pk:") != NULL) {
+        printf("Error: ROM not found in pack\n");
+        return false;
+    }
+
     // 1. 打开文件 (rb = read binary)
     FILE *f = fopen(filename, "rb");
     if (f == NULL) {
@@ -102,16 +838,204 @@ bool load_rom(Chip8 *cpu, const char *filename) {
 
     // 4. 读取文件内容到内存
     // fread(目标地址, 每个块多大, 读几块, 文件指针)
-    // 目标地址是 &cpu->memory[0x200]，也就是从第 512 个格子开始填
-    fread(&cpu->memory[0x200], 1, size, f);
+    uint8_t rom[4096 - 512];
+    fread(rom, 1, size, f);
 
     // 5. 收尾
     fclose(f);
+
+    // 6. 拷到 0x200 (第 512 个格子) 开始的地方，再做安全检查
+    return load_rom_bytes(cpu, rom, size);
+}
+
+// === 新增：跳过等定时器的空转循环 ===
+// 很多 ROM (比如 Pong) 用这三条指令等延时定时器归零：
+//   pc:   FX07      VX = delay
+//   pc+2: 3X00      VX == 0 就跳出去
+//   pc+4: 1[pc]     否则跳回 pc
+// 每圈 3 个周期，没有任何别的副作用，所以可以算出要转几圈直接跳过。
+// 调用时已经读到了非 0 的值；返回 true 表示跳过了 (pc 留在 FX07 不动)。
+bool is_delay_wait(const Chip8 *cpu, uint8_t x) {
+    if (cpu->pc + 5 >= 4096) return false;
+
+    uint16_t next = (cpu->memory[cpu->pc + 2] << 8) | cpu->memory[cpu->pc + 3];
+    uint16_t jump = (cpu->memory[cpu->pc + 4] << 8) | cpu->memory[cpu->pc + 5];
+    return next == (0x3000 | (x << 8)) && jump == (0x1000 | cpu->pc);
+}
+
+bool skip_delay_wait(Chip8 *cpu, uint8_t x) {
+    if (cpu->cycle_limit == 0 || !is_delay_wait(cpu, x)) return false;
+
+    // 读到 0 之前一共还要转 ceil(v / 3) 圈，但不能超过这一批的周期数
+    uint64_t laps = (cpu->V[x] + 2) / 3;
+    uint64_t room = (cpu->cycle_limit - cpu->cycles) / 3;
+    if (laps > room) laps = room;
+    if (laps == 0) return false;
+
+    // 最后一圈读到的值 (马上会被真正的 FX07 覆盖，这里只是保持一致)
+    cpu->V[x] = get_delay_timer(cpu) - (uint8_t)(3 * (laps - 1));
+    // 指令末尾还会再 +1
+    cpu->cycles += 3 * laps - 1;
     return true;
 }
 
+// === 新增：推迟绘制 (Display List) ===
+
+// 判断从 addr 开始执行，VF 会不会在被读之前先被覆盖 (也就是 VF "死了")。
+// 只看很短的一段，遇到跳转就跟过去，遇到条件跳过就两条路都看；
+// 拿不准的情况 (返回、BNNN、不认识的指令、看太远了) 一律当作 VF 还有用。
+// budget 是两条路一起用的总步数：第二条路只能用第一条剩下的，
+// 不然一串条件跳过每条都翻一倍，DXYN 一次要看上万条指令。
+bool vf_dead_walk(const Chip8 *cpu, uint16_t addr, int *budget) {
+    while ((*budget)-- > 0) {
+        if (addr + 1 >= 4096) return false;
+        uint16_t op = (cpu->memory[addr] << 8) | cpu->memory[addr + 1];
+        uint8_t x = (op & 0x0F00) >> 8;
+        uint8_t y = (op & 0x00F0) >> 4;
+
+        switch (op & 0xF000) {
+            case 0x0000:
+                if (op != 0x00E0) return false; // 00EE 之类的跟不过去
+                break;
+            case 0x1000:
+                addr = op & 0x0FFF;
+                continue;
+            case 0x2000:
+                addr = op & 0x0FFF; // 子程序里接着看
+                continue;
+            case 0x3000:
+            case 0x4000:
+                if (x == 0xF) return false;
+                // 跳不跳两种情况都得是死的
+                return vf_dead_walk(cpu, addr + 2, budget) && vf_dead_walk(cpu, addr + 4, budget);
+            case 0x6000:
+            case 0xC000:
+                if (x == 0xF) return true; // 直接覆盖 VF
+                break;
+            case 0x7000:
+                if (x == 0xF) return false;
+                break;
+            case 0x8000:
+                {
+                    uint8_t n = op & 0x000F;
+                    if (n > 5) return false;                      // 我们没实现的 8 系列
+                    if (y == 0xF || (n != 0 && x == 0xF)) return false; // 读了 VF
+                    if (n == 4 || n == 5 || x == 0xF) return true;      // 写了 VF
+                }
+                break;
+            case 0xA000:
+                break;
+            case 0xD000:
+                return true; // 下一次画图会重新设置 VF
+            case 0xE000:
+                if (x == 0xF) return false;
+                return vf_dead_walk(cpu, addr + 2, budget) && vf_dead_walk(cpu, addr + 4, budget);
+            case 0xF000:
+                if ((op & 0x00FF) == 0x07) {
+                    if (x == 0xF) return true;
+                } else if ((op & 0x00FF) == 0x15 || (op & 0x00FF) == 0x18) {
+                    if (x == 0xF) return false;
+                } else {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+        addr += 2;
+    }
+    return false;
+}
+
+// 从 addr 开始最多看 budget 条指令
+bool vf_dead_from(const Chip8 *cpu, uint16_t addr, int budget) {
+    return vf_dead_walk(cpu, addr, &budget);
+}
+
+// 把一行精灵的 8 个 bit 展开成 8 个字节 (gfx 是一个像素一个字节)，按小端的 64 位整数存：
+// 最左边的像素 (最高位) 在最低的字节。编译时就算好，好几个线程一起画也不用管初始化
+#define SPRITE_EXPAND(b) ((uint64_t)(((b) >> 7) & 1)       | (uint64_t)(((b) >> 6) & 1) << 8  | \
+                          (uint64_t)(((b) >> 5) & 1) << 16 | (uint64_t)(((b) >> 4) & 1) << 24 | \
+                          (uint64_t)(((b) >> 3) & 1) << 32 | (uint64_t)(((b) >> 2) & 1) << 40 | \
+                          (uint64_t)(((b) >> 1) & 1) << 48 | (uint64_t)((b) & 1) << 56)
+#define SPRITE_EXPAND4(b) SPRITE_EXPAND(b), SPRITE_EXPAND(b + 1), SPRITE_EXPAND(b + 2), SPRITE_EXPAND(b + 3)
+#define SPRITE_EXPAND16(b) SPRITE_EXPAND4(b), SPRITE_EXPAND4(b + 4), SPRITE_EXPAND4(b + 8), SPRITE_EXPAND4(b + 12)
+#define SPRITE_EXPAND64(b) SPRITE_EXPAND16(b), SPRITE_EXPAND16(b + 16), SPRITE_EXPAND16(b + 32), SPRITE_EXPAND16(b + 48)
+const uint64_t sprite_expand[256] = {
+    SPRITE_EXPAND64(0), SPRITE_EXPAND64(64), SPRITE_EXPAND64(128), SPRITE_EXPAND64(192)
+};
+
+// 把攒下的精灵一次画完。不用管碰撞，所以每行是一次 64 位的 XOR；
+// 只有跨过右边界要绕回去 (或者截掉) 的行才一个一个像素画。
+void flush_display_list(Chip8 *cpu) {
+    if (cpu->display_count == 0) return;
+
+    bool clip = cpu->quirks & QUIRK_EDGE;
+    for (int i = 0; i < cpu->display_count; ++i) {
+        const PendingSprite *s = &cpu->display_list[i];
+        int px = s->x % 64;
+        for (int row = 0; row < s->height; ++row) {
+            if (clip && s->y % 32 + row >= 32) break;
+            uint8_t *line = &cpu->gfx[((s->y + row) % 32) * 64];
+            if (px <= 64 - 8) {
+                uint64_t bits;
+                memcpy(&bits, &line[px], 8);
+                bits ^= sprite_expand[s->rows[row]];
+                memcpy(&line[px], &bits, 8);
+            } else {
+                for (int xline = 0; xline < 8; xline++) {
+                    if (clip && px + xline >= 64) break;
+                    if (s->rows[row] & (0x80 >> xline)) line[(px + xline) % 64] ^= 1;
+                }
+            }
+        }
+    }
+    cpu->display_count = 0;
+}
+
+// 把一次 DXYN 记进列表。同一个精灵在同一个位置画两次 = 什么都没画 (XOR 两次抵消)，
+// 而且 XOR 的先后顺序无所谓，所以在列表里找到一样的就直接把两个都划掉。
+void queue_sprite(Chip8 *cpu, uint8_t x, uint8_t y, uint8_t height) {
+    PendingSprite s;
+    memset(&s, 0, sizeof(s));
+    s.x = x;
+    s.y = y;
+    s.height = height;
+    for (int row = 0; row < height; ++row) {
+        s.rows[row] = cpu->memory[cpu->I + row];
+    }
+
+    for (int i = 0; i < cpu->display_count; ++i) {
+        if (memcmp(&cpu->display_list[i], &s, sizeof(s)) == 0) {
+            cpu->display_list[i] = cpu->display_list[--cpu->display_count];
+            return;
+        }
+    }
+
+    if (cpu->display_count == DISPLAY_LIST_SIZE) flush_display_list(cpu);
+    cpu->display_list[cpu->display_count++] = s;
+}
+
+// === 新增：帧边界检测 ===
+// 画过图之后第一次等定时器：这一帧画完了
+void mark_frame_boundary(Chip8 *cpu) {
+    if (cpu->draws_since_wait > 0) {
+        cpu->frame_ready = true;
+        cpu->draws_since_wait = 0;
+    }
+}
+
 // === 新增：CPU 周期函数 ===
 void emulate_cycle(Chip8 *cpu) {
+    // 0. 加固模式：已经停机了就只走时钟；PC 越界就停机
+    if (cpu->hardened) {
+        if (cpu->fault == 0 && cpu->pc + 1 >= 4096) cpu_fault(cpu, CPU_FAULT_PC);
+        if (cpu->fault != 0) {
+            cpu->cycles++;
+            return;
+        }
+    }
+
     // 1. 取指 (Fetch)
     // 从内存 pc 处拿两个字节，拼成一个 16 位的 opcode
     uint8_t byte1 = cpu->memory[cpu->pc];
@@ -127,12 +1051,18 @@ void emulate_cycle(Chip8 *cpu) {
         case 0x0000:
             // 0x00E0: 清屏 (你之前写过了)
             if ((opcode & 0x00FF) == 0x00E0) {
+                cpu->display_count = 0; // 还没画的也不用画了
                 memset(cpu->gfx, 0, 64 * 32);
+                cpu->draws_since_wait++;
                 cpu->draw_flag = true;
                 cpu->pc += 2;
             } 
             // === 新增：0x00EE 返回指令 (Return from Subroutine) ===
             else if ((opcode & 0x00FF) == 0x00EE) {
+                if (cpu->hardened && cpu->sp == 0) {
+                    cpu_fault(cpu, CPU_FAULT_STACK_UNDERFLOW);
+                    break;
+                }
                 // 1. 栈指针往回退一格 (回到上一层)
                 cpu->sp--;
                 // 2. 把 PC 恢复成当时存进去的地址
@@ -151,7 +1081,7 @@ void emulate_cycle(Chip8 *cpu) {
         case 0x1000:
             // 0x1NNN: 跳转 (Jump) 到地址 NNN
             // 比如 1200 就是跳到 0x200
-            printf("指令执行: 跳转到 0x%X\n", opcode & 0x0FFF);
+            if (cpu_log && !cpu->quiet) printf("指令执行: 跳转到 0x%X\n", opcode & 0x0FFF);
             cpu->pc = opcode & 0x0FFF; 
             // 注意：跳转指令直接修改了 pc，所以不需要 cpu->pc += 2
             break;
@@ -165,6 +1095,10 @@ void emulate_cycle(Chip8 *cpu) {
             // 你的代码结构里，case 内部都写了 pc += 2。
             // 所以这里最稳妥的写法是：
             
+            if (cpu->hardened && cpu->sp >= 16) {
+                cpu_fault(cpu, CPU_FAULT_STACK_OVERFLOW);
+                break;
+            }
             cpu->stack[cpu->sp] = cpu->pc; // 记下“我现在在哪”
             cpu->sp++;                     // 栈指针进一格
             
@@ -214,8 +1148,8 @@ void emulate_cycle(Chip8 *cpu) {
                 uint8_t nn = (opcode & 0x00FF);
                 
                 // 生成一个 0-255 的随机数，然后和 NN 做与运算
-                // 需要在 main 开头加 srand(time(NULL));
-                cpu->V[x] = (rand() % 256) & nn;
+                // (种子来自 init_cpu，main 开头的 srand(time(NULL)) 决定)
+                cpu->V[x] = (cpu_rand(cpu) % 256) & nn;
                 
                 cpu->pc += 2;
             }
@@ -231,6 +1165,10 @@ void emulate_cycle(Chip8 *cpu) {
                     case 0x9E: // EX9E: 如果按键 V[x] 被按下了，就跳过下一条
                         {
                             uint8_t key_index = cpu->V[x];
+                            if (cpu->hardened && key_index > 0xF) {
+                                cpu_fault(cpu, CPU_FAULT_KEY);
+                                break;
+                            }
                             if (cpu->key[key_index] != 0) {
                                 cpu->pc += 4;
                             } else {
@@ -242,6 +1180,10 @@ void emulate_cycle(Chip8 *cpu) {
                     case 0xA1: // EXA1: 如果按键 V[x] 没被按下，就跳过 (你的报错 E0A1 就在这)
                         {
                             uint8_t key_index = cpu->V[x];
+                            if (cpu->hardened && key_index > 0xF) {
+                                cpu_fault(cpu, CPU_FAULT_KEY);
+                                break;
+                            }
                             if (cpu->key[key_index] == 0) {
                                 cpu->pc += 4;
                             } else {
@@ -251,7 +1193,8 @@ void emulate_cycle(Chip8 *cpu) {
                         break;
                         
                     default:
-                        printf("Unknown Opcode: 0x%X\n", opcode);
+                        if (cpu_log && !cpu->quiet) printf("Unknown Opcode: 0x%X\n", opcode);
+                        cpu->unknown_ops++;
                         cpu->pc += 2;
                 }
             }
@@ -266,22 +1209,45 @@ void emulate_cycle(Chip8 *cpu) {
                 switch (opcode & 0x00FF) {
                     
                     case 0x07: // FX07: 把计时器的时间读给 VX (你报错的那个 F007)
-                        cpu->V[x] = cpu->delay_timer;
+                        cpu->V[x] = get_delay_timer(cpu);
+                        if (cpu->V[x] != 0 && is_delay_wait(cpu, x)) mark_frame_boundary(cpu);
+                        // 空转等待 "FX07 / 3X00 / 1NNN(跳回 FX07)" 直接快进，见 skip_delay_wait
+                        if (cpu->V[x] != 0 && skip_delay_wait(cpu, x)) {
+                            break; // pc 停在这条 FX07 上，下次真的去读
+                        }
                         cpu->pc += 2;
                         break;
 
                     case 0x15: // FX15: 把 VX 的值设置给 计时器 (Pong 肯定也会用到)
-                        cpu->delay_timer = cpu->V[x];
+                        set_delay_timer(cpu, cpu->V[x]);
+                        mark_frame_boundary(cpu);
                         cpu->pc += 2;
                         break;
                     
                     case 0x18: // FX18: 设置声音计时器
-                        cpu->sound_timer = cpu->V[x];
+                        set_sound_timer(cpu, cpu->V[x]);
+                        cpu->pc += 2;
+                        break;
+
+                    case 0x55: // FX55: 把 V0..VX 存到 I 开始的内存
+                    case 0x65: // FX65: 从 I 开始的内存读回 V0..VX
+                        if (cpu->hardened && cpu->I + x >= 4096) {
+                            cpu_fault(cpu, CPU_FAULT_MEMORY);
+                            break;
+                        }
+                        if ((opcode & 0x00FF) == 0x55) {
+                            memcpy(&cpu->memory[cpu->I], cpu->V, x + 1);
+                        } else {
+                            memcpy(cpu->V, &cpu->memory[cpu->I], x + 1);
+                        }
+                        // COSMAC 上 I 会跟着走到最后一个的后面
+                        if (!(cpu->quirks & QUIRK_LOAD_STORE)) cpu->I += x + 1;
                         cpu->pc += 2;
                         break;
 
                     default:
-                        printf("Unknown Opcode: 0x%X\n", opcode);
+                        if (cpu_log && !cpu->quiet) printf("Unknown Opcode: 0x%X\n", opcode);
+                        cpu->unknown_ops++;
                         cpu->pc += 2;
                 }
             }
@@ -294,7 +1260,7 @@ void emulate_cycle(Chip8 *cpu) {
                 uint8_t x = (opcode & 0x0F00) >> 8; // 取出 X (第2位)
                 uint8_t nn = (opcode & 0x00FF);     // 取出 NN (最后2位)
                 cpu->V[x] = nn;
-                printf("指令执行: 设置 V[%d] = 0x%X\n", x, nn);
+                if (cpu_log && !cpu->quiet) printf("指令执行: 设置 V[%d] = 0x%X\n", x, nn);
                 cpu->pc += 2;
             }
             break;
@@ -306,7 +1272,7 @@ void emulate_cycle(Chip8 *cpu) {
                 uint8_t x = (opcode & 0x0F00) >> 8;
                 uint8_t nn = (opcode & 0x00FF);
                 cpu->V[x] += nn;
-                printf("指令执行: V[%d] += 0x%X\n", x, nn);
+                if (cpu_log && !cpu->quiet) printf("指令执行: V[%d] += 0x%X\n", x, nn);
                 cpu->pc += 2;
             }
             break;
@@ -326,14 +1292,17 @@ void emulate_cycle(Chip8 *cpu) {
 
                     case 0x1: // 8XY1: Set Vx = Vx OR Vy (或运算)
                         cpu->V[x] |= cpu->V[y];
+                        if (cpu->quirks & QUIRK_VF_RESET) cpu->V[0xF] = 0;
                         break;
 
                     case 0x2: // 8XY2: Set Vx = Vx AND Vy (与运算)
                         cpu->V[x] &= cpu->V[y];
+                        if (cpu->quirks & QUIRK_VF_RESET) cpu->V[0xF] = 0;
                         break;
 
                     case 0x3: // 8XY3: Set Vx = Vx XOR Vy (异或)
                         cpu->V[x] ^= cpu->V[y];
+                        if (cpu->quirks & QUIRK_VF_RESET) cpu->V[0xF] = 0;
                         break;
 
                     case 0x4: // 8XY4: Set Vx = Vx + Vy (加法，带进位 VF)
@@ -362,10 +1331,27 @@ void emulate_cycle(Chip8 *cpu) {
                         }
                         break;
 
-                    // ... 还有 8XY6, 8XY7, 8XYE 等位移指令，Pong 暂时用不到，先不管 ...
+                    case 0x6: // 8XY6: 右移一位，VF = 移出去的那一位 (移谁看 QUIRK_SHIFT)
+                        {
+                            uint8_t src = (cpu->quirks & QUIRK_SHIFT) ? cpu->V[x] : cpu->V[y];
+                            cpu->V[x] = src >> 1;
+                            cpu->V[0xF] = src & 1;
+                        }
+                        break;
+
+                    case 0xE: // 8XYE: 左移一位，VF = 移出去的那一位
+                        {
+                            uint8_t src = (cpu->quirks & QUIRK_SHIFT) ? cpu->V[x] : cpu->V[y];
+                            cpu->V[x] = src << 1;
+                            cpu->V[0xF] = src >> 7;
+                        }
+                        break;
+
+                    // ... 还有 8XY7，Pong 暂时用不到，先不管 ...
 
                     default:
-                        printf("Unknown Opcode: 0x%X\n", opcode);
+                        if (cpu_log && !cpu->quiet) printf("Unknown Opcode: 0x%X\n", opcode);
+                        cpu->unknown_ops++;
                 }
                 cpu->pc += 2; // 所有的 8 系列指令都要 +2
             }
@@ -377,6 +1363,12 @@ void emulate_cycle(Chip8 *cpu) {
             cpu->pc += 2;
             break;
 
+        case 0xB000:
+            // 0xBNNN: 跳到 NNN + V0 (QUIRK_JUMP: 当成 BXNN，跳到 XNN + VX)
+            // 可能跳出 4KB，不过有 BNNN 的 ROM 过不了 verify_rom，跑的是加固核心，下一条就会停机
+            cpu->pc = (opcode & 0x0FFF) + cpu->V[(cpu->quirks & QUIRK_JUMP) ? (opcode & 0x0F00) >> 8 : 0];
+            break;
+
         case 0xD000:
             // 0xDXYN: 在 (VX, VY) 画一个宽 8 高 N 的精灵
             {
@@ -385,18 +1377,41 @@ void emulate_cycle(Chip8 *cpu) {
                 uint16_t y = cpu->V[(opcode & 0x00F0) >> 4];
                 uint16_t height = opcode & 0x000F; // N (高度)
                 uint16_t pixel;
+                if (cpu->hardened && cpu->I + height > 4096) {
+                    cpu_fault(cpu, CPU_FAULT_MEMORY);
+                    break;
+                }
+                cpu->draws_since_wait++;
+
+                // 后面没人读 VF 的话，先记下来，帧结束再画
+                if (!cpu->eager_draw && vf_dead_from(cpu, cpu->pc + 2, 16)) {
+                    queue_sprite(cpu, x, y, height);
+                    cpu->draw_flag = true;
+                    cpu->pc += 2;
+                    break;
+                }
+
+                // 要算碰撞，就得先把之前攒的画上去
+                flush_display_list(cpu);
 
                 // 2. 重置碰撞标志 VF = 0
                 cpu->V[0xF] = 0;
 
-                // 3. 逐行绘制
+                // 3. 逐行绘制 (QUIRK_EDGE: 起点还是绕回屏幕里，但超出边的部分截掉)
+                bool clip = cpu->quirks & QUIRK_EDGE;
+                if (clip) {
+                    x %= 64;
+                    y %= 32;
+                }
                 for (int yline = 0; yline < height; yline++) {
+                    if (clip && y + yline >= 32) break;
                     // 从内存 I 处取出一行像素数据 (1个字节 = 8个点)
                     pixel = cpu->memory[cpu->I + yline];
 
                     // 4. 逐个比特处理 (一行8个点)
                     for (int xline = 0; xline < 8; xline++) {
                         // 检查数据里这一个 bit 是不是 1 (0x80 是 10000000)
+                        if (clip && x + xline >= 64) break;
                         if ((pixel & (0x80 >> xline)) != 0) {
                             // 算出在屏幕数组 gfx 中的绝对位置
                             // % 64 和 % 32 是为了防止画出屏幕外面 (Wrap around)
@@ -425,68 +1440,4208 @@ void emulate_cycle(Chip8 *cpu) {
         // ... 以后还有更多指令填在这里 ...
 
         default:
-            printf("尚未实现的指令: 0x%X\n", opcode);
+            if (cpu_log && !cpu->quiet) printf("尚未实现的指令: 0x%X\n", opcode);
+            cpu->unknown_ops++;
             cpu->pc += 2; // 遇到不认识的也跳过，防止死循环
             break;
     }
 
-    // 3. 更新计时器 (以后做)
-    if (cpu->delay_timer > 0) cpu->delay_timer--;
-    if (cpu->sound_timer > 0) cpu->sound_timer--;
+    // 3. 更新计时器：只要走一下时钟，定时器的值是读的时候算出来的
+    cpu->cycles++;
 }
 
-// 在 main 函数上面加
-void debug_render(Chip8 *cpu) {
-    // 这是一个清屏命令 (Linux/Mac 专用)，为了不让屏幕闪烁太厉害
-    printf("\033[H\033[J"); 
+// 单调时钟，单位毫秒 (SDL 还没初始化的时候也能用)
+double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
 
-    // 遍历 32 行
-    for (int y = 0; y < 32; ++y) {
-        // 遍历 64 列
-        for (int x = 0; x < 64; ++x) {
-            // 如果显存是 1，画个实心块，否则画空格
-            if (cpu->gfx[x + (y * 64)]) {
-                printf("█"); 
-            } else {
-                printf(" ");
-            }
-        }
-        printf("\n"); // 换行
+// === 新增：采样分析器 (看宿主机的时间花在模拟的哪条指令上) ===
+// 按条数统计看不出贵的指令：一条 DXYN 比一条 6XNN 贵得多。
+// 做法：用 timer_create 按主线程的 CPU 时间每 1ms 发一次 SIGPROF，
+// 信号处理函数里只记下 "当前模拟的 PC + 主线程正在干什么 (阶段)"，写进一个无锁的环形缓冲；
+// 主循环每帧把缓冲倒进直方图，退出时打印排行。平时开着也几乎没有开销。
+#define PROF_RING 4096 // 2 的幂
+#ifndef sigev_notify_thread_id // 老的 glibc 没有这个名字
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+enum { PROF_OTHER, PROF_INTERP, PROF_JIT, PROF_RENDER, PROF_SDL, PROF_AUDIO, PROF_PHASES };
+const char *prof_phase_names[PROF_PHASES] = { "other", "interpreter", "jit block", "render", "sdl", "audio" };
+
+typedef struct {
+    uint32_t ring[PROF_RING];      // 每个样本：pc << 8 | 阶段
+    atomic_uint head;              // 信号处理函数写
+    unsigned tail;                 // 主循环读
+    uint32_t pc_hits[4096];        // 模拟代码 (解释器 + JIT) 里的样本，按 PC 统计
+    uint32_t phase_hits[PROF_PHASES];
+    uint32_t dropped;              // 主循环来不及倒，环形缓冲满了丢掉的
+    timer_t timer;
+} Profiler;
+
+Profiler *prof = NULL;                // NULL 表示没开
+const Chip8 *volatile prof_cpu = NULL; // 信号来的时候读它的 pc
+volatile uint8_t prof_phase = PROF_OTHER;
+
+// 切换阶段，返回原来的阶段，用完了再设回去
+uint8_t prof_enter(uint8_t phase) {
+    uint8_t old = prof_phase;
+    prof_phase = phase;
+    return old;
+}
+
+void prof_signal(int sig) {
+    (void)sig;
+    Profiler *p = prof;
+    const Chip8 *cpu = prof_cpu;
+    if (p == NULL) return;
+    unsigned h = atomic_load_explicit(&p->head, memory_order_relaxed);
+    if (h - p->tail >= PROF_RING) {
+        p->dropped++;
+        return;
     }
+    p->ring[h % PROF_RING] = (uint32_t)(cpu ? cpu->pc & 0x0FFF : 0) << 8 | prof_phase;
+    atomic_store_explicit(&p->head, h + 1, memory_order_release);
 }
 
-int main(int argc, char *argv[]) {
-    srand(time(NULL)); // <--- 加这行，初始化随机数种子
+// 只统计主线程的 CPU 时间，信号也只发给主线程 (别的线程是编译器、声卡回调)
+bool prof_start(Profiler *p, int hz) {
+    memset(p, 0, sizeof(*p));
+    struct sigaction sa = { 0 };
+    sa.sa_handler = prof_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) != 0) return false;
 
-    if (argc < 2) { printf("Usage: ./chip8 <rom>\n"); return 1; }
+    struct sigevent ev = { 0 };
+    ev.sigev_notify = SIGEV_THREAD_ID;
+    ev.sigev_signo = SIGPROF;
+    ev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &ev, &p->timer) != 0) return false;
+
+    prof = p;
+    struct itimerspec its = { 0 };
+    its.it_interval.tv_nsec = 1000000000L / hz;
+    its.it_value = its.it_interval;
+    if (timer_settime(p->timer, 0, &its, NULL) != 0) {
+        timer_delete(p->timer);
+        prof = NULL;
+        return false;
+    }
+    return true;
+}
+
+// 把环形缓冲里的样本倒进直方图 (主循环每帧调一次)
+void prof_drain(Profiler *p) {
+    unsigned h = atomic_load_explicit(&p->head, memory_order_acquire);
+    for (; p->tail != h; p->tail++) {
+        uint32_t s = p->ring[p->tail % PROF_RING];
+        uint8_t phase = s & 0xFF;
+        p->phase_hits[phase]++;
+        if (phase == PROF_INTERP || phase == PROF_JIT) p->pc_hits[s >> 8]++;
+    }
+}
+
+void prof_stop(Profiler *p, const Chip8 *cpu, int top) {
+    timer_delete(p->timer);
+    prof = NULL;
+    prof_drain(p);
+
+    uint32_t total = 0;
+    for (int i = 0; i < PROF_PHASES; ++i) total += p->phase_hits[i];
+    printf("Profile: %u samples (%u dropped)\n", total, p->dropped);
+    if (total == 0) return;
+    for (int i = 0; i < PROF_PHASES; ++i) {
+        if (p->phase_hits[i]) printf("  %-12s %6u  %5.1f%%\n", prof_phase_names[i], p->phase_hits[i], 100.0 * p->phase_hits[i] / total);
+    }
+
+    // 最贵的几个 PC：每次挑一个最大的，不用排序整张表
+    static uint8_t taken[4096];
+    memset(taken, 0, sizeof(taken));
+    printf("  hottest emulated addresses:\n");
+    for (int n = 0; n < top; ++n) {
+        int best = -1;
+        for (int pc = 0; pc < 4096; ++pc) {
+            if (!taken[pc] && p->pc_hits[pc] && (best < 0 || p->pc_hits[pc] > p->pc_hits[best])) best = pc;
+        }
+        if (best < 0) break;
+        taken[best] = 1;
+        uint16_t op = best < 4095 ? (cpu->memory[best] << 8) | cpu->memory[best + 1] : 0;
+        printf("    0x%03X  %04X  %6u  %5.1f%%\n", best, op, p->pc_hits[best], 100.0 * p->pc_hits[best] / total);
+    }
+}
+
+// === 新增：JIT (把热点代码翻译成 C，用系统的 cc 编译成 .so 再 dlopen) ===
+// 只翻译 "一串连续的纯寄存器指令" (6XNN / 7XNN / 8XY0~8XY5 / ANNN)：
+// 这些指令不碰内存、屏幕、计时器，也不会跳转，翻译成 C 语句一一对应，很安全。
+// 编译在后台线程做，编译好之前照常用解释器跑，模拟线程永远不会等编译器。
+#define JIT_HOT 500        // 一个块的入口执行这么多次就拿去编译
+#define JIT_MIN_BLOCK 3    // 太短的块不值得跳过去
+#define JIT_MAX_BLOCK 32
+#define JIT_MAX_MODULES 1024
+
+typedef void (*JitFn)(uint8_t *V, uint16_t *I);
+
+enum { JIT_NONE, JIT_QUEUED, JIT_READY, JIT_FAILED };
+
+typedef struct {
+    _Atomic(JitFn) fn;
+    atomic_int state;  // JIT_xxx
+    uint8_t len;       // 块里有几条指令
+    uint8_t quirks;    // 按哪套怪癖翻译的 (8XY1~8XY3 要不要清 VF)
+    uint8_t code[JIT_MAX_BLOCK * 2]; // 编译时的原始字节，内存变了 (热重载/换 ROM) 就作废
+} JitBlock;
+
+typedef struct {
+    JitBlock blocks[4096];  // 按块的入口地址索引
+    uint32_t hits[4096];
+    // 模拟线程 -> 编译线程的请求队列
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    uint16_t queue[256];
+    int head, tail;
+    bool quit;
+    pthread_t worker;
+    char dir[64];           // 放生成的 .c/.so 的临时目录
+    void *modules[JIT_MAX_MODULES];
+    atomic_int nmodules;
+    // 统计
+    uint64_t cycles_jit;    // 有多少周期是在编译好的代码里跑的
+    uint64_t entries;
+    double compile_ms;
+    int failed;
+} Jit;
+
+Jit *cpu_jit = NULL; // NULL 表示没开 JIT
+
+bool jit_alu_op(uint16_t op) {
+    switch (op & 0xF000) {
+        case 0x6000: case 0x7000: case 0xA000: return true;
+        case 0x8000: return (op & 0x000F) <= 0x5;
+        default: return false;
+    }
+}
+
+// 从 pc 开始往下数，有几条能翻译的指令
+int jit_block_len(const Chip8 *cpu, uint16_t pc) {
+    int n = 0;
+    while (n < JIT_MAX_BLOCK && pc + 2 * n + 1 < 4096) {
+        uint16_t op = (cpu->memory[pc + 2 * n] << 8) | cpu->memory[pc + 2 * n + 1];
+        if (!jit_alu_op(op)) break;
+        n++;
+    }
+    return n;
+}
+
+// 把一个块写成 C 源码。语句的顺序和 emulate_cycle 里完全一样 (比如 8XY5 先写 VF 再减)，
+// 所以 X 或 Y 正好是 F 的时候结果也一样
+void jit_emit(FILE *f, const JitBlock *b) {
+    uint16_t used = 0;
+    bool uses_i = false;
+    for (int k = 0; k < b->len; ++k) {
+        uint16_t op = (b->code[2 * k] << 8) | b->code[2 * k + 1];
+        if ((op & 0xF000) == 0xA000) { uses_i = true; continue; }
+        used |= 1 << ((op & 0x0F00) >> 8);
+        if ((op & 0xF000) == 0x8000) used |= (1 << ((op & 0x00F0) >> 4)) | (1 << 0xF);
+    }
+
+    const char *vf_reset = (b->quirks & QUIRK_VF_RESET) ? " vF = 0;" : "";
+    fprintf(f, "#include <stdint.h>\nvoid block(uint8_t *V, uint16_t *I) {\n");
+    // 寄存器先读到局部变量里，编译器才敢放进寄存器 (uint8_t 指针和什么都可能重叠)
+    for (int r = 0; r < 16; ++r) {
+        if (used & (1 << r)) fprintf(f, "    uint8_t v%X = V[%d];\n", r, r);
+    }
+    for (int k = 0; k < b->len; ++k) {
+        uint16_t op = (b->code[2 * k] << 8) | b->code[2 * k + 1];
+        int x = (op & 0x0F00) >> 8, y = (op & 0x00F0) >> 4, nn = op & 0x00FF;
+        switch (op & 0xF000) {
+            case 0x6000: fprintf(f, "    v%X = 0x%02X;\n", x, nn); break;
+            case 0x7000: fprintf(f, "    v%X = (uint8_t)(v%X + 0x%02X);\n", x, x, nn); break;
+            case 0xA000: fprintf(f, "    *I = 0x%03X;\n", op & 0x0FFF); break;
+            case 0x8000:
+                switch (op & 0x000F) {
+                    case 0x0: fprintf(f, "    v%X = v%X;\n", x, y); break;
+                    case 0x1: fprintf(f, "    v%X |= v%X;%s\n", x, y, vf_reset); break;
+                    case 0x2: fprintf(f, "    v%X &= v%X;%s\n", x, y, vf_reset); break;
+                    case 0x3: fprintf(f, "    v%X ^= v%X;%s\n", x, y, vf_reset); break;
+                    case 0x4: fprintf(f, "    { unsigned s = v%X + v%X; vF = s > 255; v%X = (uint8_t)s; }\n", x, y, x); break;
+                    case 0x5: fprintf(f, "    vF = v%X >= v%X; v%X = (uint8_t)(v%X - v%X);\n", x, y, x, x, y); break;
+                }
+                break;
+        }
+    }
+    for (int r = 0; r < 16; ++r) {
+        if (used & (1 << r)) fprintf(f, "    V[%d] = v%X;\n", r, r);
+    }
+    if (!uses_i) fprintf(f, "    (void)I;\n");
+    fprintf(f, "}\n");
+}
+
+// 编译一个块，成功就把函数指针发布出去
+void jit_compile(Jit *jit, uint16_t pc) {
+    JitBlock *b = &jit->blocks[pc];
+    char src[128], so[128], cmd[512];
+    snprintf(src, sizeof(src), "%s/block_%03X.c", jit->dir, pc);
+    snprintf(so, sizeof(so), "%s/block_%03X_%d.so", jit->dir, pc, atomic_load(&jit->nmodules));
+
+    double t0 = now_ms();
+    FILE *f = fopen(src, "w");
+    if (f == NULL) {
+        atomic_store(&b->state, JIT_FAILED);
+        return;
+    }
+    jit_emit(f, b);
+    fclose(f);
+
+    snprintf(cmd, sizeof(cmd), "cc -O2 -shared -fPIC -o '%s' '%s' 2>/dev/null", so, src);
+    void *h = NULL;
+    if (system(cmd) == 0) h = dlopen(so, RTLD_NOW | RTLD_LOCAL);
+    JitFn fn = h ? (JitFn)dlsym(h, "block") : NULL;
+    unlink(src);
+    unlink(so); // dlopen 之后文件就可以删了
+
+    jit->compile_ms += now_ms() - t0;
+    if (fn == NULL) {
+        if (h) dlclose(h);
+        jit->failed++;
+        atomic_store(&b->state, JIT_FAILED);
+        return;
+    }
+    int m = atomic_load(&jit->nmodules);
+    jit->modules[m] = h;
+    atomic_store(&jit->nmodules, m + 1);
+    atomic_store_explicit(&b->fn, fn, memory_order_release);
+    atomic_store_explicit(&b->state, JIT_READY, memory_order_release);
+}
+
+void *jit_worker(void *arg) {
+    Jit *jit = arg;
+    pthread_mutex_lock(&jit->lock);
+    while (!jit->quit) {
+        if (jit->head == jit->tail) {
+            pthread_cond_wait(&jit->wake, &jit->lock);
+            continue;
+        }
+        uint16_t pc = jit->queue[jit->head++ % 256];
+        pthread_mutex_unlock(&jit->lock);
+        jit_compile(jit, pc);
+        pthread_mutex_lock(&jit->lock);
+    }
+    pthread_mutex_unlock(&jit->lock);
+    return NULL;
+}
+
+bool jit_open(Jit *jit) {
+    memset(jit, 0, sizeof(*jit));
+    strcpy(jit->dir, "/tmp/chip8-jit-XXXXXX");
+    if (mkdtemp(jit->dir) == NULL) return false;
+    pthread_mutex_init(&jit->lock, NULL);
+    pthread_cond_init(&jit->wake, NULL);
+    if (pthread_create(&jit->worker, NULL, jit_worker, jit) != 0) {
+        rmdir(jit->dir);
+        return false;
+    }
+    return true;
+}
+
+// 排队去编译 pc 开头的块 (只在模拟线程调用)
+void jit_request(Jit *jit, const Chip8 *cpu, uint16_t pc) {
+    JitBlock *b = &jit->blocks[pc];
+    int len = jit_block_len(cpu, pc);
+    if (len < JIT_MIN_BLOCK || atomic_load(&jit->nmodules) >= JIT_MAX_MODULES) {
+        atomic_store(&b->state, JIT_FAILED);
+        return;
+    }
+    pthread_mutex_lock(&jit->lock);
+    if (jit->tail - jit->head < 256) {
+        b->len = len;
+        b->quirks = cpu->quirks;
+        memcpy(b->code, &cpu->memory[pc], 2 * len);
+        atomic_store(&b->state, JIT_QUEUED);
+        jit->queue[jit->tail++ % 256] = pc;
+        pthread_cond_signal(&jit->wake);
+    }
+    pthread_mutex_unlock(&jit->lock);
+}
+
+// 在块入口处试着跑编译好的代码，跑了返回 true。
+// 块的周期数必须放得进这一批 (cycle_limit)，不然就交给解释器一条一条跑
+bool jit_enter(Jit *jit, Chip8 *cpu) {
+    uint16_t pc = cpu->pc;
+    JitBlock *b = &jit->blocks[pc];
+    int state = atomic_load_explicit(&b->state, memory_order_acquire);
+    if (state == JIT_READY) {
+        if (cpu->cycles + b->len > cpu->cycle_limit) return false;
+        if (b->quirks != cpu->quirks || memcmp(b->code, &cpu->memory[pc], 2 * b->len) != 0) {
+            // ROM 或者怪癖换了，这个块作废，以后重新统计
+            atomic_store(&b->state, JIT_NONE);
+            jit->hits[pc] = 0;
+            return false;
+        }
+        JitFn fn = atomic_load_explicit(&b->fn, memory_order_acquire);
+        prof_phase = PROF_JIT;
+        fn(cpu->V, &cpu->I);
+        cpu->pc += 2 * b->len;
+        cpu->cycles += b->len;
+        jit->cycles_jit += b->len;
+        jit->entries++;
+        return true;
+    }
+    if (state == JIT_NONE && ++jit->hits[pc] >= JIT_HOT) jit_request(jit, cpu, pc);
+    return false;
+}
+
+void jit_close(Jit *jit) {
+    pthread_mutex_lock(&jit->lock);
+    jit->quit = true;
+    pthread_cond_signal(&jit->wake);
+    pthread_mutex_unlock(&jit->lock);
+    pthread_join(jit->worker, NULL);
+
+    int n = atomic_load(&jit->nmodules);
+    printf("JIT: %d blocks compiled (%.1f ms avg, %d failed), %llu entries, %llu cycles in compiled code\n",
+           n, n ? jit->compile_ms / n : 0.0, jit->failed,
+           (unsigned long long)jit->entries, (unsigned long long)jit->cycles_jit);
+    for (int i = 0; i < n; ++i) dlclose(jit->modules[i]);
+    rmdir(jit->dir);
+}
+
+// 一次跑 n 条指令。空转等待定时器的循环会被整段跳过，
+// 但不会跳出这一批的范围，所以按周期算的速度和以前一样。
+// stop_at_frame 为 true 时，碰到帧边界就提前返回，返回值是实际跑了多少个周期。
+int run_cycles_until(Chip8 *cpu, int n, bool stop_at_frame) {
+    uint64_t start = cpu->cycles;
+    cpu->cycle_limit = cpu->cycles + n;
+    // JIT 只在 "块的开头" 计数/进入：上一条是顺着走过来的纯寄存器指令，就说明在块中间
+    bool in_block = false;
+    while (cpu->cycles < cpu->cycle_limit) {
+        prof_phase = PROF_INTERP;
+        if (cpu_jit != NULL && !in_block && cpu->fault == 0 && jit_enter(cpu_jit, cpu)) {
+            in_block = false;
+            continue;
+        }
+        uint16_t pc = cpu->pc;
+        emulate_cycle(cpu);
+        in_block = cpu_jit != NULL && cpu->pc == pc + 2 &&
+                   jit_alu_op((cpu->memory[pc] << 8) | cpu->memory[pc + 1]);
+        if (stop_at_frame && cpu->frame_ready) break;
+    }
+    prof_phase = PROF_OTHER;
+    cpu->cycle_limit = 0;
+    // 一帧结束，把推迟的绘制画到 gfx 上
+    flush_display_list(cpu);
+    return (int)(cpu->cycles - start);
+}
+
+void run_cycles(Chip8 *cpu, int n) {
+    run_cycles_until(cpu, n, false);
+}
+
+// 在 main 函数上面加
+void debug_render(Chip8 *cpu) {
+    flush_display_list(cpu);
+    // 这是一个清屏命令 (Linux/Mac 专用)，为了不让屏幕闪烁太厉害
+    printf("\033[H\033[J"); 
+
+    // 遍历 32 行
+    for (int y = 0; y < 32; ++y) {
+        // 遍历 64 列
+        for (int x = 0; x < 64; ++x) {
+            // 如果显存是 1，画个实心块，否则画空格
+            if (cpu->gfx[x + (y * 64)]) {
+                printf("█"); 
+            } else {
+                printf(" ");
+            }
+        }
+        printf("\n"); // 换行
+    }
+}
+
+// === 新增：内存监视表达式 (奖励函数 / 搜索目标 / 条件断点) ===
+// 写法和 C 差不多，比如：
+//   m[0x3F0] == 3            V3 > 10 && I == 0x2EA          changed(m[0x3F0])
+// 能读的东西：V[n] (或 V0..VF)、m[addr] / memory[addr]、key[n]、I、pc、sp、dt、st
+// 编译成一串 "寄存器" 字节码，每条指令 = 一个小运算，求值的时候就是一个 switch 循环，
+// 不用每次都重新解析字符串。常量下标 (m[0x3F0]) 会直接编进指令里。
+enum {
+    W_CONST, W_V, W_V_K, W_MEM, W_MEM_K, W_KEY, W_I, W_PC, W_SP, W_DT, W_ST,
+    W_ADD, W_SUB, W_AND, W_OR, W_XOR, W_SHL, W_SHR,
+    W_EQ, W_NE, W_LT, W_GT, W_LE, W_GE, W_LAND, W_LOR,
+    W_NOT, W_NEG, W_BNOT, W_CHANGED
+};
+
+typedef struct {
+    uint8_t op;
+    uint8_t dst, a, b; // 寄存器编号
+    int32_t imm;       // 常量 / 常量下标 / changed() 的槽位
+} WatchInsn;
+
+#define WATCH_MAX_CODE 64
+#define WATCH_MAX_REGS 16
+#define WATCH_MAX_SLOTS 8
+
+typedef struct {
+    char text[128];
+    WatchInsn code[WATCH_MAX_CODE];
+    int len;
+    int32_t slots[WATCH_MAX_SLOTS]; // changed() 记住的上一次的值
+    int nslots;
+    bool is_break; // true: 条件断点，成立时暂停
+    bool last;     // 上一次的结果，只在 "不成立 -> 成立" 的时候报告
+} Watch;
+
+// 编译器状态 (递归下降)
+typedef struct {
+    const char *p;
+    Watch *w;
+    int nreg;   // 下一个空闲寄存器
+    bool error;
+} WatchParser;
+
+void wp_skip(WatchParser *ps) {
+    while (*ps->p == ' ' || *ps->p == '\t') ps->p++;
+}
+
+// 如果接下来是 tok 就吃掉它
+bool wp_accept(WatchParser *ps, const char *tok) {
+    wp_skip(ps);
+    size_t n = strlen(tok);
+    if (strncmp(ps->p, tok, n) != 0) return false;
+    // 名字后面不能紧跟字母数字 (否则 "pc" 会匹配到 "pcx")
+    char last = tok[n - 1];
+    bool word = (last >= 'a' && last <= 'z') || (last >= 'A' && last <= 'Z');
+    char next = ps->p[n];
+    if (word && ((next >= 'a' && next <= 'z') || (next >= 'A' && next <= 'Z') ||
+                 (next >= '0' && next <= '9') || next == '_')) return false;
+    ps->p += n;
+    return true;
+}
+
+int wp_emit(WatchParser *ps, uint8_t op, int a, int b, int32_t imm) {
+    if (ps->w->len >= WATCH_MAX_CODE || ps->nreg >= WATCH_MAX_REGS) {
+        ps->error = true;
+        return 0;
+    }
+    int dst = ps->nreg++;
+    ps->w->code[ps->w->len++] = (WatchInsn){ op, (uint8_t)dst, (uint8_t)a, (uint8_t)b, imm };
+    return dst;
+}
+
+// 二元运算：结果放回左边那个寄存器，右边的寄存器释放掉
+int wp_binary(WatchParser *ps, uint8_t op, int a, int b) {
+    ps->nreg = a;
+    return wp_emit(ps, op, a, b, 0);
+}
+
+int wp_expr(WatchParser *ps);
+
+// 刚生成的那条指令是不是常量？是的话把值拿出来并撤销它 (用来把常量下标编进指令)
+bool wp_take_const(WatchParser *ps, int reg, int32_t *value) {
+    if (ps->w->len == 0) return false;
+    WatchInsn *last = &ps->w->code[ps->w->len - 1];
+    if (last->op != W_CONST || last->dst != reg) return false;
+    *value = last->imm;
+    ps->w->len--;
+    ps->nreg = reg;
+    return true;
+}
+
+// [下标]：常量下标用 op_k，否则用 op
+int wp_index(WatchParser *ps, uint8_t op, uint8_t op_k, int32_t mask) {
+    if (!wp_accept(ps, "[")) { ps->error = true; return 0; }
+    int idx = wp_expr(ps);
+    if (!wp_accept(ps, "]")) { ps->error = true; return 0; }
+    int32_t k;
+    if (op_k != op && wp_take_const(ps, idx, &k)) {
+        return wp_emit(ps, op_k, 0, 0, k & mask);
+    }
+    ps->nreg = idx;
+    return wp_emit(ps, op, idx, 0, mask);
+}
+
+int wp_primary(WatchParser *ps) {
+    wp_skip(ps);
+    const char *p = ps->p;
+
+    if (*p >= '0' && *p <= '9') {
+        char *end;
+        // 0x 开头是十六进制，其它都是十进制 (不按 C 的规矩把 010 当八进制)
+        bool hex = p[0] == '0' && (p[1] == 'x' || p[1] == 'X');
+        long v = strtol(p, &end, hex ? 16 : 10);
+        ps->p = end;
+        return wp_emit(ps, W_CONST, 0, 0, (int32_t)v);
+    }
+    if (wp_accept(ps, "(")) {
+        int r = wp_expr(ps);
+        if (!wp_accept(ps, ")")) ps->error = true;
+        return r;
+    }
+    if (wp_accept(ps, "changed")) {
+        if (!wp_accept(ps, "(")) { ps->error = true; return 0; }
+        int r = wp_expr(ps);
+        if (!wp_accept(ps, ")") || ps->w->nslots >= WATCH_MAX_SLOTS) { ps->error = true; return 0; }
+        ps->nreg = r;
+        return wp_emit(ps, W_CHANGED, r, 0, ps->w->nslots++);
+    }
+    if (wp_accept(ps, "memory") || wp_accept(ps, "m")) return wp_index(ps, W_MEM, W_MEM_K, 0xFFF);
+    if (wp_accept(ps, "key")) return wp_index(ps, W_KEY, W_KEY, 0xF);
+    if (wp_accept(ps, "pc")) return wp_emit(ps, W_PC, 0, 0, 0);
+    if (wp_accept(ps, "sp")) return wp_emit(ps, W_SP, 0, 0, 0);
+    if (wp_accept(ps, "dt")) return wp_emit(ps, W_DT, 0, 0, 0);
+    if (wp_accept(ps, "st")) return wp_emit(ps, W_ST, 0, 0, 0);
+    if (wp_accept(ps, "I")) return wp_emit(ps, W_I, 0, 0, 0);
+    if (*p == 'V' || *p == 'v') {
+        char c = p[1];
+        int n = (c >= '0' && c <= '9') ? c - '0' :
+                (c >= 'A' && c <= 'F') ? c - 'A' + 10 :
+                (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if (n >= 0) { // V3 / VF
+            ps->p += 2;
+            return wp_emit(ps, W_V_K, 0, 0, n);
+        }
+        ps->p++;
+        return wp_index(ps, W_V, W_V_K, 0xF); // V[3]
+    }
+
+    ps->error = true;
+    return 0;
+}
+
+int wp_unary(WatchParser *ps) {
+    if (wp_accept(ps, "!")) { int r = wp_unary(ps); ps->nreg = r; return wp_emit(ps, W_NOT, r, 0, 0); }
+    if (wp_accept(ps, "-")) { int r = wp_unary(ps); ps->nreg = r; return wp_emit(ps, W_NEG, r, 0, 0); }
+    if (wp_accept(ps, "~")) { int r = wp_unary(ps); ps->nreg = r; return wp_emit(ps, W_BNOT, r, 0, 0); }
+    return wp_primary(ps);
+}
+
+int wp_additive(WatchParser *ps) {
+    int r = wp_unary(ps);
+    while (!ps->error) {
+        if (wp_accept(ps, "+")) r = wp_binary(ps, W_ADD, r, wp_unary(ps));
+        else if (wp_accept(ps, "-")) r = wp_binary(ps, W_SUB, r, wp_unary(ps));
+        else break;
+    }
+    return r;
+}
+
+int wp_shift(WatchParser *ps) {
+    int r = wp_additive(ps);
+    while (!ps->error) {
+        if (wp_accept(ps, "<<")) r = wp_binary(ps, W_SHL, r, wp_additive(ps));
+        else if (wp_accept(ps, ">>")) r = wp_binary(ps, W_SHR, r, wp_additive(ps));
+        else break;
+    }
+    return r;
+}
+
+int wp_compare(WatchParser *ps) {
+    int r = wp_shift(ps);
+    // 注意先试两个字符的
+    if (wp_accept(ps, "==")) return wp_binary(ps, W_EQ, r, wp_shift(ps));
+    if (wp_accept(ps, "!=")) return wp_binary(ps, W_NE, r, wp_shift(ps));
+    if (wp_accept(ps, "<=")) return wp_binary(ps, W_LE, r, wp_shift(ps));
+    if (wp_accept(ps, ">=")) return wp_binary(ps, W_GE, r, wp_shift(ps));
+    if (wp_accept(ps, "<")) return wp_binary(ps, W_LT, r, wp_shift(ps));
+    if (wp_accept(ps, ">")) return wp_binary(ps, W_GT, r, wp_shift(ps));
+    return r;
+}
+
+// 位运算 & ^ | (不能把 && || 吃掉)
+int wp_bitwise(WatchParser *ps) {
+    int r = wp_compare(ps);
+    while (!ps->error) {
+        wp_skip(ps);
+        char c = ps->p[0], n = ps->p[1];
+        if (c == '&' && n != '&') { ps->p++; r = wp_binary(ps, W_AND, r, wp_compare(ps)); }
+        else if (c == '^') { ps->p++; r = wp_binary(ps, W_XOR, r, wp_compare(ps)); }
+        else if (c == '|' && n != '|') { ps->p++; r = wp_binary(ps, W_OR, r, wp_compare(ps)); }
+        else break;
+    }
+    return r;
+}
+
+// && 和 || 不做短路：全是只读的小运算，直接算两边比跳来跳去还快，
+// 而且 changed() 每次都会更新它记住的值
+int wp_logical_and(WatchParser *ps) {
+    int r = wp_bitwise(ps);
+    while (!ps->error && wp_accept(ps, "&&")) r = wp_binary(ps, W_LAND, r, wp_bitwise(ps));
+    return r;
+}
+
+int wp_expr(WatchParser *ps) {
+    int r = wp_logical_and(ps);
+    while (!ps->error && wp_accept(ps, "||")) r = wp_binary(ps, W_LOR, r, wp_logical_and(ps));
+    return r;
+}
+
+// 编译表达式。失败时打印出错的位置
+bool watch_compile(Watch *w, const char *text, bool is_break) {
+    memset(w, 0, sizeof(*w));
+    snprintf(w->text, sizeof(w->text), "%s", text);
+    w->is_break = is_break;
+
+    WatchParser ps = { text, w, 0, false };
+    int r = wp_expr(&ps);
+    wp_skip(&ps);
+    if (ps.error || *ps.p != '\0' || r != 0) {
+        printf("Watch syntax error near \"%s\" in: %s\n", ps.p, text);
+        return false;
+    }
+    return true;
+}
+
+// 求值：结果总在 0 号寄存器。
+// 表达式是用户随手写的，溢出、负数移位都不能是未定义行为：
+// 加减、取负、左移按 32 位无符号回绕，移位数不在 0..31 就当移出去了
+int32_t watch_eval(Watch *w, const Chip8 *cpu) {
+    int32_t r[WATCH_MAX_REGS] = { 0 };
+    for (int i = 0; i < w->len; ++i) {
+        const WatchInsn *in = &w->code[i];
+        int32_t a = r[in->a], b = r[in->b];
+        int32_t v;
+        switch (in->op) {
+            case W_CONST:   v = in->imm; break;
+            case W_V:       v = cpu->V[a & 0xF]; break;
+            case W_V_K:     v = cpu->V[in->imm]; break;
+            case W_MEM:     v = cpu->memory[a & 0xFFF]; break;
+            case W_MEM_K:   v = cpu->memory[in->imm]; break;
+            case W_KEY:     v = cpu->key[a & 0xF]; break;
+            case W_I:       v = cpu->I; break;
+            case W_PC:      v = cpu->pc; break;
+            case W_SP:      v = cpu->sp; break;
+            case W_DT:      v = get_delay_timer(cpu); break;
+            case W_ST:      v = get_sound_timer(cpu); break;
+            case W_ADD:     v = (int32_t)((uint32_t)a + (uint32_t)b); break;
+            case W_SUB:     v = (int32_t)((uint32_t)a - (uint32_t)b); break;
+            case W_AND:     v = a & b; break;
+            case W_OR:      v = a | b; break;
+            case W_XOR:     v = a ^ b; break;
+            case W_SHL:     v = (b < 0 || b > 31) ? 0 : (int32_t)((uint32_t)a << b); break;
+            case W_SHR:     v = (b < 0 || b > 31) ? (a < 0 ? -1 : 0) : a >> b; break;
+            case W_EQ:      v = a == b; break;
+            case W_NE:      v = a != b; break;
+            case W_LT:      v = a < b; break;
+            case W_GT:      v = a > b; break;
+            case W_LE:      v = a <= b; break;
+            case W_GE:      v = a >= b; break;
+            case W_LAND:    v = a && b; break;
+            case W_LOR:     v = a || b; break;
+            case W_NOT:     v = !a; break;
+            case W_NEG:     v = (int32_t)(0u - (uint32_t)a); break;
+            case W_BNOT:    v = ~a; break;
+            case W_CHANGED: v = a != w->slots[in->imm]; w->slots[in->imm] = a; break;
+            default:        v = 0; break;
+        }
+        r[in->dst] = v;
+    }
+    return r[0];
+}
+
+// changed() 的起点：用当前状态算一遍，把 "上一次的值" 填好
+void watch_prime(Watch *w, const Chip8 *cpu) {
+    w->last = watch_eval(w, cpu) != 0;
+}
+
+// 每条指令后调用：报告刚刚变成立的监视，碰到成立的断点返回 true
+bool check_watches(Watch *watches, int n, const Chip8 *cpu) {
+    bool hit_break = false;
+    for (int i = 0; i < n; ++i) {
+        bool now = watch_eval(&watches[i], cpu) != 0;
+        if (now && !watches[i].last) {
+            printf("%s hit: %s  (pc=0x%03X I=0x%03X cycle=%llu)\n",
+                   watches[i].is_break ? "Break" : "Watch", watches[i].text,
+                   cpu->pc, cpu->I, (unsigned long long)cpu->cycles);
+            if (watches[i].is_break) hit_break = true;
+        }
+        watches[i].last = now;
+    }
+    return hit_break;
+}
+
+// === 新增：RAM 搜索 (金手指那一套：找分数、生命值存在哪) ===
+// 候选范围是 4KB 内存 + 16 个 V 寄存器。用法：
+//   1. 开始搜索 (所有字节都是候选)
+//   2. 玩一会儿，按 "变了/没变/变大了/变小了/加了 N" 过滤，候选越来越少
+// 过滤的时候 32 个字节一起比 (GCC 向量扩展，开了 -mavx2 就是一条 AVX2 指令)。
+#define SEARCH_BYTES 16 // V 寄存器接在内存后面
+#define SEARCH_SIZE (4096 + 32) // 补齐到 32 的倍数，多出来的永远不是候选
+
+typedef uint8_t v32u8 __attribute__((vector_size(32)));
+
+typedef enum {
+    SEARCH_EQUAL,        // == n
+    SEARCH_NOT_EQUAL,    // != n
+    SEARCH_CHANGED,      // 和上次比变了
+    SEARCH_UNCHANGED,
+    SEARCH_INCREASED,
+    SEARCH_DECREASED,
+    SEARCH_INCREASED_BY, // 比上次正好多了 n
+    SEARCH_DECREASED_BY
+} SearchFilter;
+
+typedef struct {
+    uint8_t prev[SEARCH_SIZE] __attribute__((aligned(32))); // 上一次过滤时的值
+    uint8_t mask[SEARCH_SIZE] __attribute__((aligned(32))); // 0xFF 表示还是候选
+    int count; // 还剩几个候选
+} RamSearch;
+
+void ram_search_capture(const Chip8 *cpu, uint8_t *out) {
+    memcpy(out, cpu->memory, 4096);
+    memcpy(out + 4096, cpu->V, SEARCH_BYTES);
+    memset(out + 4096 + SEARCH_BYTES, 0, SEARCH_SIZE - 4096 - SEARCH_BYTES);
+}
+
+void ram_search_start(RamSearch *rs, const Chip8 *cpu) {
+    ram_search_capture(cpu, rs->prev);
+    memset(rs->mask, 0xFF, 4096 + SEARCH_BYTES);
+    memset(rs->mask + 4096 + SEARCH_BYTES, 0, SEARCH_SIZE - 4096 - SEARCH_BYTES);
+    rs->count = 4096 + SEARCH_BYTES;
+}
+
+// 过滤一遍，返回剩下的候选数。比完之后当前值变成下一次的 "上次"
+int ram_search_filter(RamSearch *rs, const Chip8 *cpu, SearchFilter filter, uint8_t n) {
+    uint8_t cur[SEARCH_SIZE] __attribute__((aligned(32)));
+    ram_search_capture(cpu, cur);
+
+    v32u8 vn = (v32u8){ 0 } + n; // n 广播到 32 个字节
+    uint64_t left = 0;
+    for (int i = 0; i < SEARCH_SIZE; i += 32) {
+        v32u8 c = *(v32u8 *)&cur[i];
+        v32u8 p = *(v32u8 *)&rs->prev[i];
+        v32u8 keep;
+        // 向量比较的结果：成立的字节是 0xFF，不成立是 0
+        switch (filter) {
+            case SEARCH_EQUAL:        keep = (v32u8)(c == vn); break;
+            case SEARCH_NOT_EQUAL:    keep = (v32u8)(c != vn); break;
+            case SEARCH_CHANGED:      keep = (v32u8)(c != p); break;
+            case SEARCH_UNCHANGED:    keep = (v32u8)(c == p); break;
+            case SEARCH_INCREASED:    keep = (v32u8)(c > p); break;
+            case SEARCH_DECREASED:    keep = (v32u8)(c < p); break;
+            case SEARCH_INCREASED_BY: keep = (v32u8)((v32u8)(c - p) == vn); break;
+            case SEARCH_DECREASED_BY: keep = (v32u8)((v32u8)(p - c) == vn); break;
+            default:                  keep = (v32u8){ 0 }; break;
+        }
+        v32u8 m = *(v32u8 *)&rs->mask[i] & keep;
+        *(v32u8 *)&rs->mask[i] = m;
+        *(v32u8 *)&rs->prev[i] = c;
+
+        // 数一下还剩几个：每个候选是 8 个 1
+        uint64_t words[4];
+        memcpy(words, &m, 32);
+        left += __builtin_popcountll(words[0]) + __builtin_popcountll(words[1]) +
+                __builtin_popcountll(words[2]) + __builtin_popcountll(words[3]);
+    }
+    rs->count = (int)(left / 8);
+    return rs->count;
+}
+
+// 打印前 limit 个候选
+void ram_search_print(const RamSearch *rs, int limit) {
+    printf("RAM search: %d candidates\n", rs->count);
+    for (int i = 0; i < 4096 + SEARCH_BYTES && limit > 0; ++i) {
+        if (!rs->mask[i]) continue;
+        if (i < 4096) printf("  m[0x%03X] = %d\n", i, rs->prev[i]);
+        else          printf("  V%X = %d\n", i - 4096, rs->prev[i]);
+        limit--;
+    }
+}
+
+// === 新增：撤销日志 (单步后退 / 反向继续) ===
+// 按帧倒带太粗了，找一条出错的指令得能一条一条往回退。
+// 每条指令执行之前，按它的 opcode 把它 "可能会写" 的东西的旧值记下来：
+//   - pc、I、sp 每条都记 (JournalStep，12 字节)；周期数每条正好 +1，不用记
+//   - V 寄存器、栈、内存字节、显存 (一格 8 个像素)、定时器、随机数这些
+//     只有会被写的那几格才记 (JournalEntry)
+// 后退就是把最后一条指令的旧值倒着写回去，和指令多复杂没关系，O(1)。
+// 日志是两个环，满了就丢最老的指令。
+// 只有记日志的时候走 journal_step：不推迟绘制、不跳过空转、不进 JIT，
+// 所以不记日志的时候 emulate_cycle / run_cycles 一点额外开销都没有。
+#define JOURNAL_STEPS (1 << 18)  // 默认记最近这么多条指令
+#define JOURNAL_MAX_WRITES (1 + 256) // 一条指令最多写几格 (00E0 清屏：draws_since_wait + 256 个显存字)
+
+enum { J_V, J_STACK, J_MEM, J_GFX, J_MISC }; // JournalEntry.where 的高 4 位
+enum { J_DRAWS, J_DELAY, J_SOUND, J_RNG, J_UNKNOWN }; // J_MISC 的下标
+
+typedef struct {
+    uint64_t old;
+    uint16_t where; // 种类 << 12 | 下标
+} JournalEntry;
+
+typedef struct {
+    uint16_t pc, I;
+    uint8_t sp;
+    uint8_t fault;
+    bool frame_ready;
+    uint8_t pad;
+    uint16_t count; // 这条指令记了几个 JournalEntry
+} JournalStep;
+
+typedef struct {
+    JournalStep *steps;
+    JournalEntry *entries;
+    uint32_t step_mask, entry_mask;
+    // 单调递增的序号，取模才是下标；[tail, head) 是还留着的
+    uint64_t step_head, step_tail;
+    uint64_t entry_head, entry_tail;
+} Journal;
+
+bool journal_open(Journal *j, uint32_t steps) {
+    uint32_t n = 1024;
+    while (n < steps) n <<= 1;
+    memset(j, 0, sizeof(*j));
+    j->steps = malloc((size_t)n * sizeof(JournalStep));
+    j->entries = malloc((size_t)2 * n * sizeof(JournalEntry)); // 平均一条指令写不到两格
+    j->step_mask = n - 1;
+    j->entry_mask = 2 * n - 1;
+    return j->steps != NULL && j->entries != NULL;
+}
+
+void journal_close(Journal *j) {
+    free(j->steps);
+    free(j->entries);
+    memset(j, 0, sizeof(*j));
+}
+
+// 换游戏 / 热重载 / 读档之后，以前的日志就对不上了
+void journal_clear(Journal *j) {
+    j->step_tail = j->step_head;
+    j->entry_tail = j->entry_head;
+}
+
+uint64_t journal_depth(const Journal *j) {
+    return j->step_head - j->step_tail;
+}
+
+// 丢掉最老的一条指令
+void journal_drop_oldest(Journal *j) {
+    j->entry_tail += j->steps[j->step_tail++ & j->step_mask].count;
+}
+
+// 记一格旧值，返回新的 entry_head。head 用局部变量传来传去：
+// 要是每次都写回 j->entry_head，编译器会以为它和刚写的旧值 (也是 uint64_t) 可能是同一块内存，每次都重新读
+uint64_t journal_save(const Journal *j, uint64_t head, uint16_t kind, uint16_t index, uint64_t old) {
+    j->entries[head & j->entry_mask] = (JournalEntry){ old, (uint16_t)(kind << 12 | index) };
+    return head + 1;
+}
+
+// 显存第 row 行、从第 col 列开始的 8 个像素 (一个精灵字节能碰到的全部)，过了行尾绕回行首。
+// 不按 8 对齐：对齐的话精灵一行要跨两个字，记两格
+uint64_t journal_save_gfx_span(const Journal *j, uint64_t head, const Chip8 *cpu, int row, int col) {
+    const uint8_t *line = &cpu->gfx[row * 64];
+    uint64_t old;
+    if (col <= 56) {
+        memcpy(&old, &line[col], 8);
+    } else {
+        uint8_t tmp[8];
+        for (int k = 0; k < 8; ++k) tmp[k] = line[(col + k) % 64];
+        memcpy(&old, tmp, 8);
+    }
+    return journal_save(j, head, J_GFX, row * 64 + col, old);
+}
+
+// 记下 pc 上这条指令执行之前的样子，然后执行它
+void journal_step(Journal *j, Chip8 *cpu) {
+    if (j->step_head - j->step_tail > j->step_mask) journal_drop_oldest(j);
+    while (j->step_tail < j->step_head && j->entry_head + JOURNAL_MAX_WRITES - j->entry_tail > j->entry_mask + 1) {
+        journal_drop_oldest(j);
+    }
+    JournalStep *st = &j->steps[j->step_head++ & j->step_mask];
+    uint64_t h = j->entry_head;
+    st->pc = cpu->pc;
+    st->I = cpu->I;
+    st->sp = (uint8_t)cpu->sp;
+    st->fault = cpu->fault;
+    st->frame_ready = cpu->frame_ready;
+
+    // 停机了或者 PC 越界：emulate_cycle 只会走时钟
+    if (cpu->fault == 0 && cpu->pc + 1 < 4096) {
+        uint16_t op = (cpu->memory[cpu->pc] << 8) | cpu->memory[cpu->pc + 1];
+        uint8_t x = (op & 0x0F00) >> 8;
+        switch (op & 0xF000) {
+            case 0x0000:
+                if (op == 0x00E0) {
+                    h = journal_save(j, h, J_MISC, J_DRAWS, (uint32_t)cpu->draws_since_wait);
+                    // 清屏：只有原来不是 0 的字要记
+                    for (int w = 0; w < 256; ++w) {
+                        uint64_t old;
+                        memcpy(&old, &cpu->gfx[w * 8], 8);
+                        if (old != 0) h = journal_save(j, h, J_GFX, w * 8, old);
+                    }
+                }
+                break;
+            case 0x2000:
+                if (cpu->sp < 16) h = journal_save(j, h, J_STACK, cpu->sp, cpu->stack[cpu->sp]);
+                break;
+            case 0xC000:
+                h = journal_save(j, h, J_MISC, J_RNG, cpu->rng);
+                h = journal_save(j, h, J_V, x, cpu->V[x]);
+                break;
+            case 0x6000: case 0x7000:
+                h = journal_save(j, h, J_V, x, cpu->V[x]);
+                break;
+            case 0x8000:
+                h = journal_save(j, h, J_V, x, cpu->V[x]);
+                h = journal_save(j, h, J_V, 0xF, cpu->V[0xF]);
+                break;
+            case 0xD000:
+                h = journal_save(j, h, J_MISC, J_DRAWS, (uint32_t)cpu->draws_since_wait);
+                h = journal_save(j, h, J_V, 0xF, cpu->V[0xF]);
+                for (int row = 0; row < (op & 0x000F); ++row) {
+                    h = journal_save_gfx_span(j, h, cpu, (cpu->V[(op & 0x00F0) >> 4] + row) % 32, cpu->V[x] % 64);
+                }
+                break;
+            case 0xF000:
+                if ((op & 0x00FF) == 0x07) {
+                    h = journal_save(j, h, J_MISC, J_DRAWS, (uint32_t)cpu->draws_since_wait); // 帧边界会清零
+                    h = journal_save(j, h, J_V, x, cpu->V[x]);
+                } else if ((op & 0x00FF) == 0x15) {
+                    h = journal_save(j, h, J_MISC, J_DRAWS, (uint32_t)cpu->draws_since_wait);
+                    h = journal_save(j, h, J_MISC, J_DELAY, cpu->delay_expire);
+                } else if ((op & 0x00FF) == 0x18) {
+                    h = journal_save(j, h, J_MISC, J_SOUND, cpu->sound_expire);
+                } else if ((op & 0x00FF) == 0x55) {
+                    for (int r = 0; r <= x && cpu->I + r < 4096; ++r) h = journal_save(j, h, J_MEM, cpu->I + r, cpu->memory[cpu->I + r]);
+                } else if ((op & 0x00FF) == 0x65) {
+                    for (int r = 0; r <= x; ++r) h = journal_save(j, h, J_V, r, cpu->V[r]);
+                }
+                break;
+            default:
+                break; // 跳转、跳过、ANNN、EX9E/EXA1：只改标量
+        }
+    }
+
+    uint32_t unknown = cpu->unknown_ops;
+    cpu->eager_draw = true;
+    cpu->cycle_limit = 0; // 不跳过空转 (skip_delay_wait 一下跳好多周期)
+    emulate_cycle(cpu);
+    // 不认识的指令要执行了才知道 (unknown_ops++)，事后补一格
+    if (cpu->unknown_ops != unknown) h = journal_save(j, h, J_MISC, J_UNKNOWN, unknown);
+    st->count = (uint16_t)(h - j->entry_head);
+    j->entry_head = h;
+}
+
+// 退回上一条指令之前。日志空了返回 false
+bool journal_undo(Journal *j, Chip8 *cpu) {
+    if (j->step_head == j->step_tail) return false;
+    const JournalStep *st = &j->steps[--j->step_head & j->step_mask];
+    // 倒着写回去：同一格记了两次的话 (比如 8FY4 的 VF)，最后留下的是最早的那个
+    for (int k = 0; k < st->count; ++k) {
+        const JournalEntry *e = &j->entries[--j->entry_head & j->entry_mask];
+        uint16_t index = e->where & 0x0FFF;
+        switch (e->where >> 12) {
+            case J_V: cpu->V[index] = (uint8_t)e->old; break;
+            case J_STACK: cpu->stack[index] = (uint16_t)e->old; break;
+            case J_MEM: cpu->memory[index] = (uint8_t)e->old; break;
+            case J_GFX: {
+                uint8_t *line = &cpu->gfx[index & ~63];
+                int col = index & 63;
+                if (col <= 56) {
+                    memcpy(&line[col], &e->old, 8);
+                } else {
+                    uint8_t tmp[8];
+                    memcpy(tmp, &e->old, 8);
+                    for (int b = 0; b < 8; ++b) line[(col + b) % 64] = tmp[b];
+                }
+                break;
+            }
+            case J_MISC:
+                if (index == J_DRAWS) cpu->draws_since_wait = (int)e->old;
+                else if (index == J_DELAY) cpu->delay_expire = e->old;
+                else if (index == J_SOUND) cpu->sound_expire = e->old;
+                else if (index == J_UNKNOWN) cpu->unknown_ops = (uint32_t)e->old;
+                else cpu->rng = (uint32_t)e->old;
+                break;
+        }
+    }
+    cpu->cycles--;
+    cpu->pc = st->pc;
+    cpu->I = st->I;
+    cpu->sp = st->sp;
+    cpu->fault = st->fault;
+    cpu->draw_flag = true; // 退回去了，画面得重画
+    cpu->frame_ready = st->frame_ready;
+    return true;
+}
+
+// 和 run_cycles_until 一样跑 n 条指令 (或者跑到帧边界)，只是每条都记日志
+int journal_run(Journal *j, Chip8 *cpu, int n, bool stop_at_frame) {
+    flush_display_list(cpu); // 开日志之前推迟的绘制先画掉
+    prof_phase = PROF_INTERP;
+    int done = 0;
+    while (done < n) {
+        journal_step(j, cpu);
+        done++;
+        if (stop_at_frame && cpu->frame_ready) break;
+    }
+    cpu->eager_draw = false; // 下一批要是不记日志 (run_cycles)，照常推迟绘制
+    prof_phase = PROF_OTHER;
+    return done;
+}
+
+// 反向继续：一条一条往回退，直到某个断点从 "不成立" 变成 "成立" (和往前跑的时候一样的判断)，
+// 或者日志退完了。返回退了几条
+uint64_t journal_reverse_continue(Journal *j, Chip8 *cpu, Watch *watches, int nwatches) {
+    uint64_t n = 0;
+    while (journal_undo(j, cpu)) {
+        n++;
+        if (nwatches > 0 && check_watches(watches, nwatches, cpu)) break;
+    }
+    return n;
+}
+
+// === 新增：ROM 热重载 ===
+// 用 inotify 监视 ROM 所在的目录，而不是文件本身：
+// 很多编辑器/汇编器是 "写临时文件 + rename" 的方式保存，
+// 直接监视文件的话，rename 之后旧的 watch 就失效了。
+typedef struct {
+    int fd;          // inotify 句柄 (-1 表示没开)
+    int wd;          // 目录的 watch 描述符
+    char name[256];  // 只关心这个文件名
+} RomWatcher;
+
+bool rom_watch_init(RomWatcher *w, const char *path) {
+    // dirname/basename 会改写参数，所以各拷一份
+    char dir_buf[4096], name_buf[4096];
+    snprintf(dir_buf, sizeof(dir_buf), "%s", path);
+    snprintf(name_buf, sizeof(name_buf), "%s", path);
+
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); // 非阻塞：主循环里每帧问一下就行
+    if (w->fd < 0) return false;
+
+    w->wd = inotify_add_watch(w->fd, dirname(dir_buf), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (w->wd < 0) {
+        close(w->fd);
+        w->fd = -1;
+        return false;
+    }
+    snprintf(w->name, sizeof(w->name), "%s", basename(name_buf));
+    return true;
+}
+
+// 把攒下的事件全读完，只要有一个是我们的 ROM 就返回 true
+bool rom_watch_poll(RomWatcher *w) {
+    if (w->fd < 0) return false;
+
+    bool changed = false;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(w->fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->len > 0 && strcmp(ev->name, w->name) == 0) {
+                changed = true;
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return changed;
+}
+
+void rom_watch_close(RomWatcher *w) {
+    if (w->fd >= 0) close(w->fd);
+    w->fd = -1;
+}
+
+// === 新增：ROM 静态分析 ===
+// 不运行 ROM，只从 0x200 顺着控制流把能走到的指令找出来 (数据区不算)。
+// 扫描模式 (--scan) 和怪癖检测 (quirks_detect) 都用它。
+typedef struct {
+    const char *name;
+    uint16_t mask, value;
+    bool implemented;  // emulate_cycle 里有没有实现
+    uint8_t family;    // 0 = CHIP-8, 1 = SUPER-CHIP, 2 = XO-CHIP
+} OpKind;
+
+// 顺序有讲究：先匹配更具体的 (比如 DXY0 在 DXYN 前面，F000 在 FX.. 前面)
+const OpKind op_kinds[] = {
+    { "00E0", 0xFFFF, 0x00E0, true, 0 },  { "00EE", 0xFFFF, 0x00EE, true, 0 },
+    { "00CN", 0xFFF0, 0x00C0, false, 1 }, { "00DN", 0xFFF0, 0x00D0, false, 2 },
+    { "00FB", 0xFFFF, 0x00FB, false, 1 }, { "00FC", 0xFFFF, 0x00FC, false, 1 },
+    { "00FD", 0xFFFF, 0x00FD, false, 1 }, { "00FE", 0xFFFF, 0x00FE, false, 1 },
+    { "00FF", 0xFFFF, 0x00FF, false, 1 }, { "0NNN", 0xF000, 0x0000, false, 0 },
+    { "1NNN", 0xF000, 0x1000, true, 0 },  { "2NNN", 0xF000, 0x2000, true, 0 },
+    { "3XNN", 0xF000, 0x3000, true, 0 },  { "4XNN", 0xF000, 0x4000, true, 0 },
+    { "5XY0", 0xF00F, 0x5000, false, 0 }, { "5XY2", 0xF00F, 0x5002, false, 2 },
+    { "5XY3", 0xF00F, 0x5003, false, 2 }, { "6XNN", 0xF000, 0x6000, true, 0 },
+    { "7XNN", 0xF000, 0x7000, true, 0 },  { "8XY0", 0xF00F, 0x8000, true, 0 },
+    { "8XY1", 0xF00F, 0x8001, true, 0 },  { "8XY2", 0xF00F, 0x8002, true, 0 },
+    { "8XY3", 0xF00F, 0x8003, true, 0 },  { "8XY4", 0xF00F, 0x8004, true, 0 },
+    { "8XY5", 0xF00F, 0x8005, true, 0 },  { "8XY6", 0xF00F, 0x8006, true, 0 },
+    { "8XY7", 0xF00F, 0x8007, false, 0 }, { "8XYE", 0xF00F, 0x800E, true, 0 },
+    { "9XY0", 0xF00F, 0x9000, false, 0 }, { "ANNN", 0xF000, 0xA000, true, 0 },
+    { "BNNN", 0xF000, 0xB000, true, 0 }, { "CXNN", 0xF000, 0xC000, true, 0 },
+    { "DXY0", 0xF00F, 0xD000, false, 1 }, { "DXYN", 0xF000, 0xD000, true, 0 },
+    { "EX9E", 0xF0FF, 0xE09E, true, 0 },  { "EXA1", 0xF0FF, 0xE0A1, true, 0 },
+    { "F000", 0xFFFF, 0xF000, false, 2 }, { "F002", 0xFFFF, 0xF002, false, 2 },
+    { "FN01", 0xF0FF, 0xF001, false, 2 }, { "FX07", 0xF0FF, 0xF007, true, 0 },
+    { "FX0A", 0xF0FF, 0xF00A, false, 0 }, { "FX15", 0xF0FF, 0xF015, true, 0 },
+    { "FX18", 0xF0FF, 0xF018, true, 0 },  { "FX1E", 0xF0FF, 0xF01E, false, 0 },
+    { "FX29", 0xF0FF, 0xF029, false, 0 }, { "FX30", 0xF0FF, 0xF030, false, 1 },
+    { "FX33", 0xF0FF, 0xF033, false, 0 }, { "FX3A", 0xF0FF, 0xF03A, false, 2 },
+    { "FX55", 0xF0FF, 0xF055, true, 0 }, { "FX65", 0xF0FF, 0xF065, true, 0 },
+    { "FX75", 0xF0FF, 0xF075, false, 1 }, { "FX85", 0xF0FF, 0xF085, false, 1 },
+};
+#define OP_KINDS ((int)(sizeof(op_kinds) / sizeof(op_kinds[0])))
+#define OP_INVALID OP_KINDS // 什么都不是 (比如 EX33)
+
+int op_kind(uint16_t op) {
+    for (int k = 0; k < OP_KINDS; ++k) {
+        if ((op & op_kinds[k].mask) == op_kinds[k].value) return k;
+    }
+    return OP_INVALID;
+}
+
+typedef struct {
+    char *name;           // 扫目录：strdup 出来的路径；扫包：指向包里的文件名
+    uint32_t size, hash;
+    uint32_t hist[OP_KINDS + 1];
+    uint32_t reachable;   // 能走到的指令条数
+    uint16_t lo, hi;      // 代码的地址范围
+    uint8_t quirks;       // 可能依赖哪些怪癖 (QUIRK_xxx 那一位的行为会影响这个 ROM)
+    uint8_t families;     // 第 1 位 SUPER-CHIP，第 2 位 XO-CHIP
+    bool indirect;        // 有 BNNN，后面的控制流不知道去哪
+    bool ok;
+} ScanResult;
+
+uint16_t scan_op(const uint8_t *mem, int pc) {
+    return (mem[pc] << 8) | mem[pc + 1];
+}
+
+// 往回看同一段直线代码里最近一次 6XNN 给 V[r] 赋的常量，找不到返回 -1
+int scan_const_before(const uint8_t *mem, const uint8_t *is_insn, int pc, int r) {
+    for (int back = 1; back <= 8 && pc - 2 * back >= 0x200; ++back) {
+        int p = pc - 2 * back;
+        if (!is_insn[p]) return -1;
+        uint16_t op = scan_op(mem, p);
+        uint8_t top = op >> 12;
+        if (top == 0x1 || top == 0x2 || top == 0xB || (op == 0x00EE)) return -1; // 上一条跳走了
+        if (top == 0x6 && ((op >> 8) & 0xF) == r) return op & 0xFF;
+        // 别的指令改了 V[r] 就不知道了
+        if ((top == 0x7 || top == 0x8 || top == 0xC) && ((op >> 8) & 0xF) == r) return -1;
+        if ((op & 0xF0FF) == 0xF007 && ((op >> 8) & 0xF) == r) return -1;
+        if ((op & 0xF0FF) == 0xF065 && r <= ((op >> 8) & 0xF)) return -1;
+    }
+    return -1;
+}
+
+void scan_rom(const uint8_t *rom, uint32_t size, ScanResult *out) {
+    static _Thread_local uint8_t mem[4096 + 2];
+    static _Thread_local uint8_t is_insn[4096];
+    static _Thread_local uint16_t work[2 * 4096]; // 每条指令最多压两个后继
+    memset(mem, 0, sizeof(mem));
+    memset(is_insn, 0, sizeof(is_insn));
+    memcpy(&mem[0x200], rom, size);
+    out->size = size;
+    out->hash = rom_hash(rom, size);
+    out->lo = 0xFFFF;
+
+    // 1. 顺着控制流找能走到的指令 (不跟踪栈：2NNN 两边都走，00EE 这条路就结束)
+    int nwork = 0;
+    work[nwork++] = 0x200;
+    while (nwork > 0) {
+        int pc = work[--nwork];
+        if (pc < 0x200 || pc + 1 >= 4096 || is_insn[pc]) continue;
+        is_insn[pc] = 1;
+        uint16_t op = scan_op(mem, pc);
+        int k = op_kind(op);
+        out->hist[k]++;
+        out->reachable++;
+        if (pc < out->lo) out->lo = pc;
+        if (pc + 2 > out->hi) out->hi = pc + 2;
+        if (k < OP_KINDS && op_kinds[k].family) out->families |= op_kinds[k].family;
+
+        switch (op >> 12) {
+            case 0x0:
+                if (op == 0x00EE || op == 0x00FD) break; // 返回 / SUPER-CHIP 的退出
+                work[nwork++] = pc + 2;
+                break;
+            case 0x1:
+                work[nwork++] = op & 0x0FFF;
+                break;
+            case 0x2:
+                work[nwork++] = op & 0x0FFF;
+                work[nwork++] = pc + 2;
+                break;
+            case 0x3: case 0x4: case 0x5: case 0x9:
+                work[nwork++] = pc + 2;
+                // XO-CHIP 的 F000 NNNN 是 4 字节，跳过它的时候要多跳 2 (这里只按 2 字节算)
+                work[nwork++] = pc + 4;
+                break;
+            case 0xB:
+                out->indirect = true;
+                out->quirks |= QUIRK_JUMP;
+                break;
+            case 0xE:
+                work[nwork++] = pc + 2;
+                if ((op & 0x00FF) == 0x9E || (op & 0x00FF) == 0xA1) work[nwork++] = pc + 4;
+                break;
+            case 0xF:
+                // F000 NNNN：后面两个字节是地址，不是指令
+                work[nwork++] = pc + (op == 0xF000 ? 4 : 2);
+                break;
+            default:
+                work[nwork++] = pc + 2;
+                break;
+        }
+    }
+
+    // 2. 怪癖
+    for (int pc = 0x200; pc + 1 < 4096; ++pc) {
+        if (!is_insn[pc]) continue;
+        uint16_t op = scan_op(mem, pc);
+        int x = (op >> 8) & 0xF, y = (op >> 4) & 0xF;
+        if (((op & 0xF00F) == 0x8006 || (op & 0xF00F) == 0x800E) && x != y) out->quirks |= QUIRK_SHIFT;
+        if ((op & 0xF00F) >= 0x8001 && (op & 0xF00F) <= 0x8003 && (op & 0xF000) == 0x8000) out->quirks |= QUIRK_VF_RESET;
+        if ((op & 0xF0FF) == 0xF055 || (op & 0xF0FF) == 0xF065) {
+            // 顺着往下看几条：先碰到用 I 的指令，还没碰到 ANNN，就是依赖 I 自增
+            for (int p = pc + 2, n = 0; n < 8 && p + 1 < 4096 && is_insn[p]; p += 2, ++n) {
+                uint16_t next = scan_op(mem, p);
+                if ((next & 0xF000) == 0xA000 || (next & 0xF000) == 0x1000 || (next & 0xF000) == 0x2000 || next == 0x00EE) break;
+                if ((next & 0xF000) == 0xD000 || (next & 0xF0FF) == 0xF033 || (next & 0xF0FF) == 0xF055 ||
+                    (next & 0xF0FF) == 0xF065 || (next & 0xF0FF) == 0xF01E) {
+                    out->quirks |= QUIRK_LOAD_STORE;
+                    break;
+                }
+            }
+        }
+        if ((op & 0xF000) == 0xD000) {
+            int vx = scan_const_before(mem, is_insn, pc, x);
+            int vy = scan_const_before(mem, is_insn, pc, y);
+            int n = op & 0xF;
+            if ((vx >= 0 && (vx % 64) + 8 > 64) || (vy >= 0 && (vy % 32) + n > 32)) out->quirks |= QUIRK_EDGE;
+        }
+    }
+    out->ok = true;
+}
+
+// === 新增：自动检测怪癖 (几套怪癖同时跑，看哪套最像样) ===
+// 没见过的 ROM：先用静态分析看它可能依赖哪几个怪癖 (scan_rom)，只在这几位上排列组合，
+// 每种组合一个线程，从同一个开机状态、用同一串随机按键跑 3 秒模拟时间，然后打分：
+//   - 加固核心停机了 (栈溢出/下溢、读写越界、PC 跑出内存)  大扣分
+//   - PC 跑到 ROM 外面 (多半是跳飞了)                      按帧数扣分
+//   - 执行了不认识的指令 (跑进数据里了)                     扣分
+//   - 画面的熵 (黑屏是 0，画面越丰富越高)                   加分
+// 分数一样就选改动少的。结果按 ROM 哈希记在缓存文件里，同一个 ROM 下次直接用。
+#define QUIRK_RACE_FRAMES 180
+#define QUIRK_CYCLES_PER_FRAME 10
+#define QUIRK_RACE_SEED 0x5EEDu
+
+typedef struct {
+    Chip8 cpu;
+    uint8_t quirks;
+    uint32_t runaway; // PC 在 ROM 外面的帧数
+    double entropy;
+    double score;
+} QuirkRun;
+
+// 画面的熵：每 8 个横着的像素拼成一个字节，算 256 个字节值分布的熵 (0~8 位)
+double frame_entropy(const uint8_t *gfx) {
+    uint16_t hist[256] = { 0 };
+    for (int i = 0; i < 64 * 32; i += 8) {
+        uint8_t b = 0;
+        for (int k = 0; k < 8; ++k) b = (b << 1) | gfx[i + k];
+        hist[b]++;
+    }
+    double h = 0;
+    for (int b = 0; b < 256; ++b) {
+        if (hist[b] == 0) continue;
+        double p = hist[b] / 256.0;
+        h -= p * log2(p);
+    }
+    return h;
+}
+
+// 一个参赛的怪癖组合。不走 run_cycles：那里会进 JIT，JIT 的表不是给多个线程一起用的
+void *quirk_race_worker(void *arg) {
+    QuirkRun *r = arg;
+    Chip8 *cpu = &r->cpu;
+    uint32_t lo = 0x200, hi = 0x200 + cpu->rom_size;
+    int samples = 0;
+    for (uint32_t f = 0; f < QUIRK_RACE_FRAMES; ++f) {
+        // 随机按键：每 8 帧换一次，和无界面模式的随机输入一样
+        uint32_t h = fnv1a(2166136261u ^ QUIRK_RACE_SEED, &(uint32_t){ f / 8 }, sizeof(uint32_t));
+        uint16_t keys = (uint16_t)(h & (h >> 16));
+        for (int k = 0; k < 16; ++k) cpu->key[k] = (keys >> k) & 1;
+
+        cpu->cycle_limit = cpu->cycles + QUIRK_CYCLES_PER_FRAME;
+        while (cpu->cycles < cpu->cycle_limit) emulate_cycle(cpu);
+        cpu->cycle_limit = 0;
+
+        if (cpu->pc < lo || cpu->pc >= hi) r->runaway++;
+        if (f % 15 == 14) {
+            flush_display_list(cpu);
+            r->entropy += frame_entropy(cpu->gfx);
+            samples++;
+        }
+    }
+    r->entropy /= samples;
+    r->score = r->entropy - (cpu->fault ? 100.0 : 0.0) - 20.0 * r->runaway / QUIRK_RACE_FRAMES -
+               (cpu->unknown_ops ? 5.0 : 0.0);
+    return NULL;
+}
+
+// 缓存文件：每行 "哈希 怪癖"，都是 16 进制。CHIP8_QUIRKS 环境变量可以换位置
+void quirk_cache_path(char *out, size_t len) {
+    const char *env = getenv("CHIP8_QUIRKS");
+    const char *home = getenv("HOME");
+    if (env != NULL) {
+        snprintf(out, len, "%s", env);
+    } else {
+        snprintf(out, len, "%s/.chip8-quirks", home ? home : ".");
+    }
+}
+
+bool quirk_cache_lookup(uint32_t hash, uint8_t *quirks) {
+    char path[4096], line[128];
+    quirk_cache_path(path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return false;
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), f) != NULL) {
+        unsigned h, q;
+        if (sscanf(line, "%x %x", &h, &q) == 2 && h == hash) {
+            *quirks = (uint8_t)q;
+            found = true;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// 农场的好几个线程 (或者好几个进程) 会同时往里追加，写之前锁住整个文件
+void quirk_cache_store(uint32_t hash, uint8_t quirks) {
+    char path[4096];
+    quirk_cache_path(path, sizeof(path));
+    FILE *f = fopen(path, "a");
+    if (f == NULL) return;
+    flock(fileno(f), LOCK_EX);
+    fprintf(f, "%08X %02X\n", hash, quirks);
+    fflush(f);
+    flock(fileno(f), LOCK_UN);
+    fclose(f);
+}
+
+// 给刚加载好的 ROM 选怪癖 (开机状态 boot 不会被改)
+uint8_t quirks_detect(const Chip8 *boot) {
+    double t0 = now_ms();
+    uint32_t hash = rom_hash(&boot->memory[0x200], boot->rom_size);
+    char names[64];
+    uint8_t best = boot->quirks;
+    if (quirk_cache_lookup(hash, &best)) {
+        quirks_format(best, names, sizeof(names));
+        if (rom_log) printf("Quirks: %s (cached for %08X)\n", names, hash);
+        return best;
+    }
+
+    // 1. 只在可能有影响的那几位上排列组合
+    ScanResult scan;
+    memset(&scan, 0, sizeof(scan));
+    scan_rom(&boot->memory[0x200], boot->rom_size, &scan);
+    uint8_t bits[QUIRK_COUNT];
+    int nbits = 0;
+    for (int q = 0; q < QUIRK_COUNT; ++q) {
+        if (scan.quirks & (1 << q)) bits[nbits++] = 1 << q;
+    }
+    if (nbits == 0) {
+        if (rom_log) printf("Quirks: ROM does not depend on any quirk\n");
+        return best;
+    }
+
+    // 2. 每个组合一个线程。比赛的时候不要打印指令和停机信息 (农场的好几个线程会同时比，
+    //    所以是每个 CPU 自己的 quiet，不改全局的 cpu_log/rom_log)
+    int nruns = 1 << nbits;
+    QuirkRun *runs = calloc(nruns, sizeof(QuirkRun));
+    pthread_t threads[1 << QUIRK_COUNT];
+    bool started[1 << QUIRK_COUNT];
+    if (runs == NULL) return best;
+    for (int i = 0; i < nruns; ++i) {
+        runs[i].cpu = *boot;
+        runs[i].cpu.quiet = true;
+        for (int b = 0; b < nbits; ++b) {
+            if (i & (1 << b)) runs[i].quirks |= bits[b];
+        }
+        runs[i].cpu.quirks = runs[i].quirks;
+        runs[i].cpu.hardened = true; // 错的怪癖很容易跑飞，一律带检查跑
+        runs[i].cpu.rng = QUIRK_RACE_SEED;
+        started[i] = pthread_create(&threads[i], NULL, quirk_race_worker, &runs[i]) == 0;
+        if (!started[i]) quirk_race_worker(&runs[i]);
+    }
+    for (int i = 0; i < nruns; ++i) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+
+    // 3. 分最高的赢；一样的话选设的位少的 (i 从小到大，位少的先比)
+    int win = 0;
+    for (int i = 1; i < nruns; ++i) {
+        const QuirkRun *a = &runs[i], *w = &runs[win];
+        if (a->score > w->score + 1e-9 ||
+            (a->score > w->score - 1e-9 && __builtin_popcount(a->quirks) < __builtin_popcount(w->quirks))) {
+            win = i;
+        }
+    }
+    best = runs[win].quirks;
+    quirks_format(best, names, sizeof(names));
+    if (rom_log) {
+        printf("Quirks: %s for %08X (score %.2f: entropy %.2f, runaway %u, unknown ops %u, %s; %d profiles raced in %.1f ms)\n",
+               names, hash, runs[win].score, runs[win].entropy, runs[win].runaway, runs[win].cpu.unknown_ops,
+               runs[win].cpu.fault ? fault_names[runs[win].cpu.fault] : "no fault", nruns, now_ms() - t0);
+    }
+    free(runs);
+    quirk_cache_store(hash, best);
+    return best;
+}
+
+// 加载完 ROM 之后 (--quirks auto)：选好怪癖，变了就按新的怪癖重新做安全检查
+void quirks_auto(Chip8 *cpu) {
+    uint8_t quirks = quirks_detect(cpu);
+    if (quirks == cpu->quirks) return;
+    cpu->quirks = quirks;
+    cpu_verify(cpu);
+}
+
+// === 新增：多 ROM 启动器 ===
+// 每个 ROM 加载好之后存一份 "刚开机" 的完整 CPU 状态。
+// 切换游戏 = 把这份状态整个拷回 cpu (6KB 左右的 memcpy)，窗口/渲染器都不用动。
+typedef struct {
+    char path[4096];
+    Chip8 boot; // 开机快照
+} RomSlot;
+
+typedef struct {
+    RomSlot *slots;
+    int count;
+    int capacity;
+    int current; // 正在玩的是第几个
+} Launcher;
+
+bool launcher_add(Launcher *l, const char *path) {
+    if (l->count == l->capacity) {
+        int cap = l->capacity ? l->capacity * 2 : 8;
+        RomSlot *bigger = realloc(l->slots, cap * sizeof(RomSlot));
+        if (bigger == NULL) return false;
+        l->slots = bigger;
+        l->capacity = cap;
+    }
+    RomSlot *slot = &l->slots[l->count];
+    snprintf(slot->path, sizeof(slot->path), "%s", path);
+    init_cpu(&slot->boot);
+    if (!load_rom(&slot->boot, path)) return false;
+    if (auto_quirks) quirks_auto(&slot->boot);
+    l->count++;
+    return true;
+}
+
+int compare_slots(const void *a, const void *b) {
+    return strcmp(((const RomSlot *)a)->path, ((const RomSlot *)b)->path);
+}
+
+// 把目录里所有 .ch8 都加载进来，按文件名排序
+int launcher_scan(Launcher *l, const char *dir) {
+    DIR *d = opendir(dir);
+    if (d == NULL) return 0;
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        size_t n = strlen(ent->d_name);
+        if (n < 4 || strcasecmp(ent->d_name + n - 4, ".ch8") != 0) continue;
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        if (!launcher_add(l, path)) {
+            printf("Skipping: %s\n", path);
+        }
+    }
+    closedir(d);
+
+    qsort(l->slots, l->count, sizeof(RomSlot), compare_slots);
+    return l->count;
+}
+
+// 把打包文件里的 ROM 全部加载进来 (包里本来就按名字排好了)
+int launcher_add_pack(Launcher *l, const char *path) {
+    const Pack *p = pack_get(path);
+    if (p == NULL) return 0;
+    for (uint32_t i = 0; i < p->header->count; ++i) {
+        char spec[4096];
+        snprintf(spec, sizeof(spec), "%s:%s", path, p->entries[i].name);
+        if (!launcher_add(l, spec)) {
+            printf("Skipping: %s\n", spec);
+        }
+    }
+    return l->count;
+}
+
+// 切到第 index 个游戏：恢复它的开机快照
+void launcher_switch(Launcher *l, Chip8 *cpu, int index) {
+    l->current = (index % l->count + l->count) % l->count; // 支持往回绕
+    *cpu = l->slots[l->current].boot;
+    cpu->draw_flag = true;
+    printf("Switched to [%d/%d] %s\n", l->current + 1, l->count, l->slots[l->current].path);
+}
+
+void launcher_free(Launcher *l) {
+    free(l->slots);
+    l->slots = NULL;
+    l->count = l->capacity = 0;
+}
+
+// === 新增：像素画放大滤镜 (Scale2x / Scale3x / Scale4x / xBR-lite) ===
+// CHIP-8 的画面只有黑白两色，所以一行 64 个像素正好打包成一个 64 位整数。
+// Scale 系列的规则全是 "邻居相等/不相等"，对单色图来说就是位运算：
+//   a == b  ->  ~(a ^ b)
+// 于是一条指令同时处理一整行的像素 (最多 128 个，用 __int128 装)，
+// 比按像素走 SSE/AVX 还省事。位的约定：最左边的像素在最高位。
+typedef unsigned __int128 u128;
+
+typedef enum { FILTER_NONE, FILTER_SCALE2X, FILTER_SCALE3X, FILTER_SCALE4X, FILTER_XBR } Filter;
+
+int filter_scale(Filter f) {
+    switch (f) {
+        case FILTER_SCALE2X: return 2;
+        case FILTER_SCALE3X: return 3;
+        case FILTER_SCALE4X: return 4;
+        case FILTER_XBR:     return 4;
+        default:             return 1;
+    }
+}
+
+u128 row_mask(int w) {
+    return w == 128 ? ~(u128)0 : (((u128)1 << w) - 1);
+}
+
+// 每个像素的左邻居 (边上的像素没有邻居，就当成自己)
+u128 left_of(u128 r, int w) {
+    return (r >> 1) | (r & ((u128)1 << (w - 1)));
+}
+
+// 每个像素的右邻居
+u128 right_of(u128 r, int w) {
+    return ((r << 1) & row_mask(w)) | (r & 1);
+}
+
+// cond 为 1 的位取 a，否则取 b
+u128 select_bits(u128 cond, u128 a, u128 b) {
+    return (cond & a) | (~cond & b);
+}
+
+// 把 gfx 打包成每行一个位串
+void pack_gfx(const uint8_t *gfx, u128 *rows) {
+    for (int y = 0; y < 32; ++y) {
+        uint64_t r = 0;
+        for (int x = 0; x < 64; ++x) {
+            r = (r << 1) | (gfx[y * 64 + x] & 1);
+        }
+        rows[y] = r;
+    }
+}
+
+// 把 k 个子像素行交错展开：输出像素 x*k+j 来自 sub[j] 的第 x 个像素
+void emit_rgba(uint32_t *dst, const u128 *sub, int k, int w) {
+    for (int x = 0; x < w; ++x) {
+        int bit = w - 1 - x;
+        for (int j = 0; j < k; ++j) {
+            dst[x * k + j] = ((sub[j] >> bit) & 1) ? 0xFFFFFFFF : 0x000000FF;
+        }
+    }
+}
+
+// 同上，但输出还是位串 (宽 2w，给 Scale4x 的第二遍用)
+u128 emit_bits2(const u128 *sub, int w) {
+    u128 out = 0;
+    for (int x = 0; x < w; ++x) {
+        int bit = w - 1 - x;
+        out = (out << 2) | (((sub[0] >> bit) & 1) << 1) | ((sub[1] >> bit) & 1);
+    }
+    return out;
+}
+
+// Scale2x：        B
+//               D  E  F    ->  E0 E1
+//                  H           E2 E3
+void scale2x_row(u128 b, u128 e, u128 h, int w, u128 out[4]) {
+    u128 d = left_of(e, w), f = right_of(e, w);
+    u128 db = ~(d ^ b), bf = ~(b ^ f), dh = ~(d ^ h), hf = ~(h ^ f);
+
+    out[0] = select_bits(db & ~bf & ~dh, d, e);
+    out[1] = select_bits(bf & ~db & ~hf, f, e);
+    out[2] = select_bits(dh & ~db & ~hf, d, e);
+    out[3] = select_bits(hf & ~dh & ~bf, f, e);
+}
+
+// Scale3x：      A B C
+//               D E F    ->  3x3 个子像素
+//               G H I
+void scale3x_row(u128 b, u128 e, u128 h, int w, u128 out[9]) {
+    u128 a = left_of(b, w), c = right_of(b, w);
+    u128 d = left_of(e, w), f = right_of(e, w);
+    u128 g = left_of(h, w), i = right_of(h, w);
+
+    // 四个角的基本条件 (和 Scale2x 一样)
+    u128 tl = ~(d ^ b) & (d ^ h) & (b ^ f); // D==B && D!=H && B!=F
+    u128 tr = ~(b ^ f) & (b ^ d) & (f ^ h); // B==F && B!=D && F!=H
+    u128 bl = ~(d ^ h) & (d ^ b) & (h ^ f); // D==H && D!=B && H!=F
+    u128 br = ~(h ^ f) & (d ^ h) & (b ^ f); // H==F && D!=H && B!=F
+
+    out[0] = select_bits(tl, d, e);
+    out[1] = select_bits((tl & (e ^ c)) | (tr & (e ^ a)), b, e);
+    out[2] = select_bits(tr, f, e);
+    out[3] = select_bits((tl & (e ^ g)) | (bl & (e ^ a)), d, e);
+    out[4] = e;
+    out[5] = select_bits((tr & (e ^ i)) | (br & (e ^ c)), f, e);
+    out[6] = select_bits(bl, d, e);
+    out[7] = select_bits((bl & (e ^ i)) | (br & (e ^ g)), h, e);
+    out[8] = select_bits(br, f, e);
+}
+
+// xBR-lite (4 倍)：xBR 的第一级，只认 45 度的边，边上的子像素按覆盖面积混成灰色。
+// 单色图上颜色距离只有 0/1，xBR 的 "加权距离" 就成了数邻居里有几对不一样：
+// 对右下角来说，两个方向各自的不一样程度是
+//   wd1 = d(E,C) + d(E,G) + d(I,F4) + d(I,H5) + 4 d(H,F)   (沿 H-F 这条斜线)
+//   wd2 = d(H,D) + d(H,I5) + d(F,I4) + d(F,B) + 4 d(E,I)   (沿 E-I 这条斜线)
+// wd1 < wd2 而且 E 和 F、H 都不一样，说明有一条从 F 的中点到 H 的中点的斜边，
+// E 的右下角那一小块归 H/F 的颜色。4x4 个子像素里，中心在斜边外面的 (i+j == 6) 整个换掉，
+// 正好压在斜边上的 (i+j == 5) 各占一半。其它三个角镜像一下是同一套。
+// Scale 系列只能输出黑白，xBR 能输出灰色的过渡，所以按像素走，不打包成位串
+uint8_t xbr_px(const uint8_t *gfx, int x, int y) {
+    x = x < 0 ? 0 : (x > 63 ? 63 : x); // 出了边就当成边上的像素
+    y = y < 0 ? 0 : (y > 31 ? 31 : y);
+    return gfx[y * 64 + x] & 1;
+}
+
+void upscale_xbr(const uint8_t *gfx, uint32_t *out) {
+    for (int y = 0; y < 32; ++y) {
+        for (int x = 0; x < 64; ++x) {
+            uint8_t e = xbr_px(gfx, x, y);
+            uint8_t level[4][4]; // 子像素的亮度 0..255
+            memset(level, e ? 255 : 0, sizeof(level));
+            for (int corner = 0; corner < 4; ++corner) {
+                int sx = (corner & 1) ? 1 : -1, sy = (corner & 2) ? 1 : -1;
+                // 以这个角为 "右下"，P(u, v) 是往角的方向走 u 列 v 行
+#define P(u, v) xbr_px(gfx, x + sx * (u), y + sy * (v))
+                uint8_t f = P(1, 0), h = P(0, 1), i = P(1, 1);
+                if (e == f || e == h) continue;
+                int wd1 = (e != P(1, -1)) + (e != P(-1, 1)) + (i != P(2, 1)) + (i != P(1, 2)) + 4 * (h != f);
+                int wd2 = (h != P(-1, 0)) + (h != P(1, 2)) + (f != P(2, 1)) + (f != P(0, -1)) + 4 * (e != i);
+#undef P
+                if (wd1 >= wd2) continue;
+                // 单色图里 f == h 就是要换成的颜色 (f != e)，混一半就是 128
+                for (int v = 0; v < 4; ++v) {
+                    for (int u = 0; u < 4; ++u) {
+                        int row = sy > 0 ? v : 3 - v, col = sx > 0 ? u : 3 - u;
+                        if (u + v == 6) level[row][col] = f ? 255 : 0;
+                        else if (u + v == 5) level[row][col] = 128;
+                    }
+                }
+            }
+            for (int v = 0; v < 4; ++v) {
+                for (int u = 0; u < 4; ++u) {
+                    uint32_t g = level[v][u];
+                    out[(y * 4 + v) * 256 + x * 4 + u] = (g << 24) | (g << 16) | (g << 8) | 0xFF;
+                }
+            }
+        }
+    }
+}
+
+// 对整帧做放大，结果写进 out (RGBA)，行宽 64*scale
+void upscale(Filter filter, const uint8_t *gfx, uint32_t *out) {
+    u128 rows[32], wide[64];
+    u128 sub[9];
+    if (filter == FILTER_XBR) {
+        upscale_xbr(gfx, out);
+        return;
+    }
+    pack_gfx(gfx, rows);
+
+    if (filter == FILTER_SCALE3X) {
+        int ow = 64 * 3;
+        for (int y = 0; y < 32; ++y) {
+            u128 b = rows[y > 0 ? y - 1 : 0], h = rows[y < 31 ? y + 1 : 31];
+            scale3x_row(b, rows[y], h, 64, sub);
+            for (int j = 0; j < 3; ++j) {
+                emit_rgba(out + (y * 3 + j) * ow, &sub[j * 3], 3, 64);
+            }
+        }
+        return;
+    }
+
+    // Scale2x 一遍；Scale4x 就是在 Scale2x 的结果上再来一遍
+    int w = 64, h_rows = 32;
+    const u128 *src = rows;
+    if (filter == FILTER_SCALE4X) {
+        for (int y = 0; y < 32; ++y) {
+            u128 b = rows[y > 0 ? y - 1 : 0], h = rows[y < 31 ? y + 1 : 31];
+            scale2x_row(b, rows[y], h, 64, sub);
+            wide[y * 2] = emit_bits2(&sub[0], 64);
+            wide[y * 2 + 1] = emit_bits2(&sub[2], 64);
+        }
+        w = 128;
+        h_rows = 64;
+        src = wide;
+    }
+
+    int ow = w * 2;
+    for (int y = 0; y < h_rows; ++y) {
+        u128 b = src[y > 0 ? y - 1 : 0], h = src[y < h_rows - 1 ? y + 1 : h_rows - 1];
+        scale2x_row(b, src[y], h, w, sub);
+        emit_rgba(out + (y * 2) * ow, &sub[0], 2, w);
+        emit_rgba(out + (y * 2 + 1) * ow, &sub[2], 2, w);
+    }
+}
+
+// 把 gfx 转成 RGBA (需要的话先放大)，上传纹理并显示
+void present_frame(SDL_Renderer *renderer, SDL_Texture *texture, const Chip8 *cpu,
+                   Filter filter, uint32_t *pixels) {
+    uint8_t phase = prof_enter(PROF_RENDER);
+    if (filter != FILTER_NONE) {
+        // 放大滤镜只在画面变了的帧上跑
+        upscale(filter, cpu->gfx, pixels);
+    } else {
+        for (int i = 0; i < 2048; ++i) {
+            uint8_t pixel = cpu->gfx[i];
+            // 像素为1 -> 白色(FFFFFFFF)，像素为0 -> 黑色(000000FF)
+            pixels[i] = (pixel == 1) ? 0xFFFFFFFF : 0x000000FF; 
+        }
+    }
+
+    prof_phase = PROF_SDL;
+    SDL_UpdateTexture(texture, NULL, pixels, 64 * filter_scale(filter) * sizeof(uint32_t));
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+    prof_phase = phase;
+}
+
+// === 新增：声音 (蜂鸣器) 和 "跟着声卡走" 的同步模式 ===
+// 声卡有自己的晶振，SDL_Delay(16) 跑出来的 60 帧和它永远对不齐，
+// 时间一长缓冲区不是空了 (爆音) 就是满了 (延迟越来越大)。
+// 做法：主线程每跑一帧就往环形缓冲里写这一帧的声音，声卡回调从里面读。
+//   - 开了声音就由声卡定节奏：缓冲里的声音不够了才跑下一帧，模拟速度完全由声卡的消耗决定。
+//     --audio 每次循环最多跑一帧，每一帧都有机会显示；
+//     --audio-sync 卡顿之后一次最多补 4 帧，中间几帧画了的话来不及显示，记在 coalesced 里；
+//   - 每帧写多少个采样会根据缓冲的水位微调 (±0.5%，动态码率控制)，
+//     把显示器和声卡的时钟差慢慢吸收掉，听不出音调变化。
+#define AUDIO_RATE 44100
+#define AUDIO_RING 8192                      // 2 的幂，下标直接取模
+#define AUDIO_PER_FRAME (AUDIO_RATE / 60.0)  // 每帧 735 个采样
+#define AUDIO_TARGET (AUDIO_PER_FRAME * 3)   // 缓冲里保持大约 3 帧 (~50ms)
+#define AUDIO_MAX_ADJUST 0.005
+
+typedef struct {
+    SDL_AudioDeviceID dev;
+    int16_t ring[AUDIO_RING];
+    _Atomic uint32_t read_pos;  // 只有回调写
+    _Atomic uint32_t write_pos; // 只有主线程写
+    _Atomic uint32_t underruns;
+    uint32_t overruns;
+    uint32_t coalesced; // 一次循环补了好几帧，中间画了却没显示的帧
+    int16_t last;       // 回调上一次输出的值 (缓冲空了的时候从这里慢慢回到 0，不会 "啪" 一声)
+    double phase;       // 方波相位，帧与帧之间连续
+    double gain;        // 当前音量，开关声音时渐变
+    double carry;       // 采样数的小数部分，累积到下一帧
+} Audio;
+
+void audio_callback(void *userdata, Uint8 *stream, int len) {
+    Audio *a = (Audio *)userdata;
+    int16_t *out = (int16_t *)stream;
+    int n = len / (int)sizeof(int16_t);
+
+    uint32_t r = atomic_load_explicit(&a->read_pos, memory_order_relaxed);
+    uint32_t w = atomic_load_explicit(&a->write_pos, memory_order_acquire);
+    bool starved = false;
+    for (int i = 0; i < n; ++i) {
+        if (r != w) {
+            a->last = a->ring[r % AUDIO_RING];
+            r++;
+        } else {
+            a->last = a->last * 15 / 16; // 没数据了：淡出
+            starved = true;
+        }
+        out[i] = a->last;
+    }
+    atomic_store_explicit(&a->read_pos, r, memory_order_release);
+    if (starved) atomic_fetch_add(&a->underruns, 1);
+}
+
+bool audio_open(Audio *a) {
+    memset(a, 0, sizeof(*a));
+    // 用到声音才初始化音频子系统
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) return false;
+
+    SDL_AudioSpec want, have;
+    memset(&want, 0, sizeof(want));
+    want.freq = AUDIO_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = 512;
+    want.callback = audio_callback;
+    want.userdata = a;
+    a->dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+    if (a->dev == 0) return false;
+    SDL_PauseAudioDevice(a->dev, 0);
+    return true;
+}
+
+uint32_t audio_fill(Audio *a) {
+    return atomic_load_explicit(&a->write_pos, memory_order_relaxed) -
+           atomic_load_explicit(&a->read_pos, memory_order_acquire);
+}
+
+// 为了把缓冲填到目标水位，现在该跑几帧 (一次最多 max 帧，防止卡顿后狂追)
+int audio_frames_wanted(Audio *a, int max) {
+    double missing = AUDIO_TARGET - audio_fill(a);
+    if (missing <= 0) return 0;
+    int frames = (int)(missing / AUDIO_PER_FRAME) + 1;
+    return frames > max ? max : frames;
+}
+
+// 跑完一帧之后写这一帧的声音：sound timer 不为 0 就响 440Hz 方波
+void audio_produce(Audio *a, bool beeping) {
+    uint8_t phase = prof_enter(PROF_AUDIO);
+    uint32_t fill = audio_fill(a);
+    double adjust = AUDIO_MAX_ADJUST * (AUDIO_TARGET - (double)fill) / AUDIO_TARGET;
+    if (adjust > AUDIO_MAX_ADJUST) adjust = AUDIO_MAX_ADJUST;
+    if (adjust < -AUDIO_MAX_ADJUST) adjust = -AUDIO_MAX_ADJUST;
+
+    double want = AUDIO_PER_FRAME * (1.0 + adjust) + a->carry;
+    int n = (int)want;
+    a->carry = want - n;
+
+    uint32_t w = atomic_load_explicit(&a->write_pos, memory_order_relaxed);
+    double target_gain = beeping ? 0.25 : 0.0;
+    for (int i = 0; i < n; ++i) {
+        if (w - atomic_load_explicit(&a->read_pos, memory_order_acquire) >= AUDIO_RING) {
+            a->overruns++; // 满了，这一帧剩下的不要了
+            break;
+        }
+        // 音量每个采样最多变 1/64，开关声音都是渐变的
+        if (a->gain < target_gain) a->gain = fmin(target_gain, a->gain + 1.0 / 64);
+        if (a->gain > target_gain) a->gain = fmax(target_gain, a->gain - 1.0 / 64);
+        double square = (a->phase < 0.5) ? 1.0 : -1.0;
+        a->phase += 440.0 / AUDIO_RATE;
+        if (a->phase >= 1.0) a->phase -= 1.0;
+        a->ring[w % AUDIO_RING] = (int16_t)(square * a->gain * 32767);
+        w++;
+    }
+    atomic_store_explicit(&a->write_pos, w, memory_order_release);
+    prof_phase = phase;
+}
+
+void audio_close(Audio *a) {
+    if (a->dev == 0) return;
+    SDL_CloseAudioDevice(a->dev);
+    printf("Audio: %u underruns, %u overruns, %u frames not shown\n", atomic_load(&a->underruns), a->overruns,
+           a->coalesced);
+}
+
+// === 新增：网格模式 ===
+// 同时跑 n 个实例，每个实例的画面是大纹理 (图集) 上的一个 64x32 格子。
+// 每帧只重写这一帧画过图的格子，只上传被改过的那几行格子，
+// 最后整张图集只 RenderCopy 一次，而不是每个实例一次。
+void grid_draw_tile(uint32_t *atlas, int atlas_w, int tile_x, int tile_y, const Chip8 *cpu) {
+    uint32_t *row = atlas + tile_y * 32 * atlas_w + tile_x * 64;
+    for (int y = 0; y < 32; ++y, row += atlas_w) {
+        const uint8_t *src = &cpu->gfx[y * 64];
+        for (int x = 0; x < 64; ++x) {
+            row[x] = src[x] ? 0xFFFFFFFF : 0x000000FF;
+        }
+    }
+}
+
+void run_grid(SDL_Renderer *renderer, const Launcher *l, int n) {
+    // 尽量排成正方形
+    int cols = 1;
+    while (cols * cols < n) cols++;
+    int rows = (n + cols - 1) / cols;
+    int atlas_w = cols * 64, atlas_h = rows * 32;
+
+    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, atlas_w, atlas_h);
+    uint32_t *atlas = malloc((size_t)atlas_w * atlas_h * sizeof(uint32_t));
+    Chip8 *cpus = malloc(n * sizeof(Chip8));
+    if (texture == NULL || atlas == NULL || cpus == NULL) {
+        printf("Error: grid of %d instances is too big\n", n);
+        free(atlas);
+        free(cpus);
+        if (texture) SDL_DestroyTexture(texture);
+        return;
+    }
+
+    for (int i = 0; i < atlas_w * atlas_h; ++i) atlas[i] = 0x000000FF; // 空格子是黑的
+    for (int i = 0; i < n; ++i) cpus[i] = l->slots[i % l->count].boot; // 多个 ROM 轮流排
+    printf("Grid: %d instances, %dx%d tiles\n", n, cols, rows);
+
+    int running = 1;
+    SDL_Event event;
+    while (running) {
+        for (int i = 0; i < n; ++i) {
+            run_cycles(&cpus[i], 10);
+        }
+
+        // 键盘输入广播给所有实例
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) running = 0;
+            if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+                for (int k = 0; k < 16; ++k) {
+                    if (event.key.keysym.sym != keymap[k]) continue;
+                    for (int i = 0; i < n; ++i) {
+                        cpus[i].key[k] = (event.type == SDL_KEYDOWN);
+                    }
+                }
+            }
+        }
+
+        // 只重画脏格子，并记下脏格子覆盖的行范围
+        int dirty_top = rows, dirty_bottom = -1;
+        for (int i = 0; i < n; ++i) {
+            if (!cpus[i].draw_flag) continue;
+            cpus[i].draw_flag = false;
+            int tx = i % cols, ty = i / cols;
+            grid_draw_tile(atlas, atlas_w, tx, ty, &cpus[i]);
+            if (ty < dirty_top) dirty_top = ty;
+            if (ty > dirty_bottom) dirty_bottom = ty;
+        }
+
+        if (dirty_bottom >= 0) {
+            SDL_Rect band = { 0, dirty_top * 32, atlas_w, (dirty_bottom - dirty_top + 1) * 32 };
+            SDL_UpdateTexture(texture, &band, atlas + band.y * atlas_w, atlas_w * sizeof(uint32_t));
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, texture, NULL, NULL);
+            SDL_RenderPresent(renderer);
+        }
+
+        SDL_Delay(16);
+    }
+
+    free(cpus);
+    free(atlas);
+    SDL_DestroyTexture(texture);
+}
+
+// 重新加载 ROM：先加载到一个新的 CPU 里，成功了才替换。
+// 这样文件写到一半/写坏了的时候，旧程序还能接着跑。
+// 新代码和旧的寄存器状态基本对不上，所以直接复位，不保留状态。
+// 开机快照也一起换掉，之后切回这个游戏拿到的就是新版本。
+void hot_reload(Chip8 *cpu, RomSlot *slot) {
+    Chip8 fresh;
+    init_cpu(&fresh);
+    if (!load_rom(&fresh, slot->path)) {
+        printf("Hot reload failed, keep running old ROM\n");
+        return;
+    }
+    // 改的是同一个游戏，怪癖不用重新猜；但 load_rom 是按默认怪癖检查的，换了怪癖要重新检查
+    if (fresh.quirks != slot->boot.quirks) {
+        fresh.quirks = slot->boot.quirks;
+        cpu_verify(&fresh);
+    }
+    slot->boot = fresh;
+    *cpu = fresh;
+    cpu->draw_flag = true; // 马上把清空后的屏幕画出来
+    printf("Hot reloaded: %s\n", slot->path);
+}
+
+// === 新增：启动耗时统计 ===
+// 后台加载 ROM 的任务：和主线程的 SDL 初始化同时进行
+// 参数是目录就进启动器模式，把里面的 ROM 全部加载
+typedef struct {
+    Launcher *launcher;
+    const char *path;
+    bool ok;
+    double ms; // 加载花了多久
+} RomLoadJob;
+
+void *rom_load_thread(void *arg) {
+    RomLoadJob *job = (RomLoadJob *)arg;
+    double t0 = now_ms();
+    struct stat st;
+    size_t n = strlen(job->path);
+    if (stat(job->path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        job->ok = launcher_scan(job->launcher, job->path) > 0;
+    } else if (n > 5 && strcmp(job->path + n - 5, ".c8pk") == 0) {
+        job->ok = launcher_add_pack(job->launcher, job->path) > 0;
+    } else {
+        job->ok = launcher_add(job->launcher, job->path);
+    }
+    job->ms = now_ms() - t0;
+    return NULL;
+}
+
+// === 新增：回滚联机 (两个进程，UDP) ===
+// Pong 这种双人游戏，两个玩家各管一半按键。每台机器：
+//   - 不等对方的输入，先 "猜" 对方还按着上一次的键，照常往下跑；
+//   - 每帧开跑之前存一份快照；
+//   - 对方的真实输入到了，发现猜错了，就读回那一帧的快照，用正确的输入重跑到现在。
+// 最多领先对方已确认的输入 NET_MAX_ROLLBACK 帧，再多就原地等一帧。
+// 为了在本机测试，可以人为给发出去的包加延迟、随机丢包。
+#define NET_MAX_ROLLBACK 8
+#define NET_HISTORY 32     // 快照/输入的环形缓冲，比回滚窗口大得多
+#define NET_REDUNDANCY 16  // 每个包都带上最近 16 帧的输入，丢几个包也没关系
+#define NET_QUEUE 256      // 模拟延迟用的发送队列
+#define NET_MAGIC 0x43384E50u // "C8NP"
+#define NET_CYCLES_PER_FRAME 10
+
+typedef struct {
+    uint32_t magic;
+    uint32_t frame;       // inputs[count-1] 是这一帧的输入，往前依次是更早的帧
+    uint32_t check_frame; // 对这一帧开头的状态做的校验 (UINT32_MAX 表示没有)
+    uint32_t check_hash;
+    uint16_t count;
+    uint16_t inputs[NET_REDUNDANCY];
+} NetPacket;
+
+typedef struct {
+    double due_ms; // 什么时候真正发出去
+    NetPacket packet;
+} NetQueued;
+
+typedef struct {
+    int sock;
+    struct sockaddr_in peer;
+    uint16_t local_mask; // 本机负责的按键 (另一半归对方)
+
+    uint32_t frame;            // 下一个要模拟的帧
+    int64_t remote_confirmed;  // 对方的输入连续确认到了哪一帧 (-1 表示还没有)
+    uint16_t last_remote;      // 最近收到的对方输入，用来猜
+    int64_t rollback_from;     // 需要从哪一帧开始重跑 (-1 表示不用)
+    uint32_t pending_check_frame; // 回滚前收到的对方校验，回滚完再比 (UINT32_MAX 表示没有)
+    uint32_t pending_check_hash;
+
+    uint16_t local_input[NET_HISTORY];
+    uint16_t remote_input[NET_HISTORY];
+    int64_t remote_known[NET_HISTORY]; // 这个格子存的是哪一帧的真实输入 (-1 表示没有)
+    uint16_t remote_used[NET_HISTORY]; // 模拟时实际用的 (可能是猜的)
+    Chip8 snapshots[NET_HISTORY];      // 第 f 帧开跑之前的状态
+
+    // 人为的网络条件
+    int delay_ms;
+    int loss_pct;
+    NetQueued queue[NET_QUEUE];
+    int queued;
+
+    // 统计
+    int rollbacks;
+    int resimulated;
+    int max_rollback;
+    int stalls;
+    bool desynced;
+} NetSession;
+
+bool net_open(NetSession *ns, int player, int local_port, const char *peer) {
+    // peer 的格式是 ip:port
+    char host[64];
+    const char *colon = strrchr(peer, ':');
+    if (colon == NULL || colon - peer >= (int)sizeof(host)) return false;
+    memcpy(host, peer, colon - peer);
+    host[colon - peer] = '\0';
+    if (strcmp(host, "localhost") == 0) strcpy(host, "127.0.0.1");
+
+    memset(&ns->peer, 0, sizeof(ns->peer));
+    ns->peer.sin_family = AF_INET;
+    ns->peer.sin_port = htons(atoi(colon + 1));
+    if (inet_pton(AF_INET, host, &ns->peer.sin_addr) != 1) return false;
+
+    ns->sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (ns->sock < 0) return false;
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(local_port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(ns->sock, (struct sockaddr *)&local, sizeof(local)) != 0) {
+        close(ns->sock);
+        return false;
+    }
+
+    // 玩家 1 管键盘左半边 (0~7，Pong 的 1/4)，玩家 2 管右半边 (8~F，Pong 的 C/D)
+    ns->local_mask = (player == 1) ? 0x00FF : 0xFF00;
+    ns->frame = 0;
+    ns->remote_confirmed = -1;
+    ns->last_remote = 0;
+    ns->rollback_from = -1;
+    ns->pending_check_frame = UINT32_MAX;
+    for (int i = 0; i < NET_HISTORY; ++i) ns->remote_known[i] = -1;
+    ns->queued = 0;
+    ns->rollbacks = ns->resimulated = ns->max_rollback = ns->stalls = 0;
+    ns->desynced = false;
+    return true;
+}
+
+// 跑一帧：存快照，合并两边的输入，跑固定的周期数
+void net_sim_frame(NetSession *ns, Chip8 *cpu, uint32_t f) {
+    int slot = f % NET_HISTORY;
+    uint16_t remote = (ns->remote_known[slot] == f) ? ns->remote_input[slot] : ns->last_remote;
+    ns->remote_used[slot] = remote;
+    ns->snapshots[slot] = *cpu;
+
+    uint16_t keys = (ns->local_input[slot] & ns->local_mask) | (remote & ~ns->local_mask);
+    for (int i = 0; i < 16; ++i) cpu->key[i] = (keys >> i) & 1;
+    run_cycles(cpu, NET_CYCLES_PER_FRAME);
+}
+
+// 第 f 帧开头的状态 (要么在快照里，要么就是现在)
+const Chip8 *net_state_at(const NetSession *ns, const Chip8 *cpu, uint32_t f) {
+    if (f == ns->frame) return cpu;
+    if (f > ns->frame || ns->frame - f >= NET_HISTORY) return NULL;
+    return &ns->snapshots[f % NET_HISTORY];
+}
+
+void net_check_desync(NetSession *ns, const Chip8 *cpu, uint32_t f, uint32_t hash) {
+    // 只有 f 之前的输入全确认了，我们这边 f 的状态才是最终的
+    if (f == UINT32_MAX || (int64_t)f > ns->remote_confirmed + 1 || ns->desynced) return;
+    const Chip8 *state = net_state_at(ns, cpu, f);
+    if (state != NULL && cpu_state_hash(state) != hash) {
+        printf("Netplay: DESYNC at frame %u\n", f);
+        ns->desynced = true;
+    }
+}
+
+void net_receive(NetSession *ns, const Chip8 *cpu) {
+    NetPacket pk;
+    ssize_t n;
+    while ((n = recv(ns->sock, &pk, sizeof(pk), 0)) > 0) {
+        if (n != sizeof(pk) || pk.magic != NET_MAGIC || pk.count > NET_REDUNDANCY) continue;
+
+        for (int i = 0; i < pk.count; ++i) {
+            int64_t f = (int64_t)pk.frame - (pk.count - 1) + i;
+            if (f <= ns->remote_confirmed || f >= (int64_t)ns->frame + NET_HISTORY / 2) continue;
+            int slot = f % NET_HISTORY;
+            if (ns->remote_known[slot] == f) continue;
+
+            ns->remote_input[slot] = pk.inputs[i];
+            ns->remote_known[slot] = f;
+            // 这一帧已经用猜的输入跑过了，而且猜错了：要回滚
+            if (f < ns->frame && ns->remote_used[slot] != pk.inputs[i] &&
+                (ns->rollback_from < 0 || f < ns->rollback_from)) {
+                ns->rollback_from = f;
+            }
+        }
+        if ((int64_t)pk.frame > ns->remote_confirmed) {
+            ns->last_remote = pk.inputs[pk.count - 1];
+        }
+        while (ns->remote_known[(ns->remote_confirmed + 1) % NET_HISTORY] == ns->remote_confirmed + 1) {
+            ns->remote_confirmed++;
+        }
+        // 要回滚的话，我们这边的快照还是按猜的输入跑出来的，对方的校验要等回滚完再比，
+        // 先记下来 (只留最新的那一个)
+        if (ns->rollback_from < 0) {
+            net_check_desync(ns, cpu, pk.check_frame, pk.check_hash);
+        } else if (pk.check_frame != UINT32_MAX &&
+                   (ns->pending_check_frame == UINT32_MAX || pk.check_frame > ns->pending_check_frame)) {
+            ns->pending_check_frame = pk.check_frame;
+            ns->pending_check_hash = pk.check_hash;
+        }
+    }
+}
+
+// 猜错了就读档重跑
+void net_rollback(NetSession *ns, Chip8 *cpu) {
+    if (ns->rollback_from < 0) return;
+    uint32_t from = (uint32_t)ns->rollback_from;
+    ns->rollback_from = -1;
+
+    *cpu = ns->snapshots[from % NET_HISTORY];
+    for (uint32_t f = from; f < ns->frame; ++f) {
+        net_sim_frame(ns, cpu, f);
+    }
+    int depth = (int)(ns->frame - from);
+    ns->rollbacks++;
+    ns->resimulated += depth;
+    if (depth > ns->max_rollback) ns->max_rollback = depth;
+
+    // 回滚前记下的对方校验，现在快照都是对的了，可以比了
+    net_check_desync(ns, cpu, ns->pending_check_frame, ns->pending_check_hash);
+    ns->pending_check_frame = UINT32_MAX;
+}
+
+void net_send(NetSession *ns, const Chip8 *cpu) {
+    if (ns->frame == 0) return;
+
+    NetPacket pk;
+    memset(&pk, 0, sizeof(pk));
+    pk.magic = NET_MAGIC;
+    pk.frame = ns->frame - 1;
+    pk.count = ns->frame < NET_REDUNDANCY ? ns->frame : NET_REDUNDANCY;
+    for (int i = 0; i < pk.count; ++i) {
+        uint32_t f = pk.frame - (pk.count - 1) + i;
+        pk.inputs[i] = ns->local_input[f % NET_HISTORY] & ns->local_mask;
+    }
+    // 顺便带上最新的 "最终状态" 的校验，对方拿去比
+    pk.check_frame = UINT32_MAX;
+    uint32_t f = (uint32_t)(ns->remote_confirmed + 1);
+    const Chip8 *state = net_state_at(ns, cpu, f);
+    if (state != NULL) {
+        pk.check_frame = f;
+        pk.check_hash = cpu_state_hash(state);
+    }
+
+    // 模拟丢包和延迟
+    if (ns->loss_pct > 0 && rand() % 100 < ns->loss_pct) return;
+    if (ns->queued == NET_QUEUE) return; // 队列满了就当丢了
+    ns->queue[ns->queued].due_ms = now_ms() + ns->delay_ms;
+    ns->queue[ns->queued].packet = pk;
+    ns->queued++;
+}
+
+// 把到时间的包真正发出去
+void net_flush(NetSession *ns) {
+    double now = now_ms();
+    int kept = 0;
+    for (int i = 0; i < ns->queued; ++i) {
+        if (ns->queue[i].due_ms <= now) {
+            sendto(ns->sock, &ns->queue[i].packet, sizeof(NetPacket), 0,
+                   (struct sockaddr *)&ns->peer, sizeof(ns->peer));
+        } else {
+            ns->queue[kept++] = ns->queue[i];
+        }
+    }
+    ns->queued = kept;
+}
+
+// 一个主机帧：收包 -> 必要时回滚 -> 往前跑一帧 (或者等一下) -> 发包
+void net_tick(NetSession *ns, Chip8 *cpu, uint16_t local_keys) {
+    net_receive(ns, cpu);
+    net_rollback(ns, cpu);
+
+    if ((int64_t)ns->frame - (ns->remote_confirmed + 1) < NET_MAX_ROLLBACK) {
+        ns->local_input[ns->frame % NET_HISTORY] = local_keys & ns->local_mask;
+        net_sim_frame(ns, cpu, ns->frame);
+        ns->frame++;
+    } else {
+        ns->stalls++; // 对方太慢了，再往前跑就超出回滚窗口了
+    }
+
+    net_send(ns, cpu);
+    net_flush(ns);
+}
+
+void run_netplay(SDL_Renderer *renderer, SDL_Texture *texture, Chip8 *cpu,
+                 Filter filter, uint32_t *pixels, NetSession *ns) {
+    uint16_t local_keys = 0;
+    int running = 1;
+    SDL_Event event;
+    while (running) {
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) running = 0;
+            if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+                for (int i = 0; i < 16; ++i) {
+                    if (event.key.keysym.sym != keymap[i]) continue;
+                    if (event.type == SDL_KEYDOWN) local_keys |= 1 << i;
+                    else local_keys &= ~(1 << i);
+                }
+            }
+        }
+
+        net_tick(ns, cpu, local_keys);
+
+        if (cpu->draw_flag) {
+            cpu->draw_flag = false;
+            present_frame(renderer, texture, cpu, filter, pixels);
+        }
+        SDL_Delay(16);
+    }
+
+    printf("Netplay: %u frames, %d rollbacks (%d frames resimulated, deepest %d), %d stalls%s\n",
+           ns->frame, ns->rollbacks, ns->resimulated, ns->max_rollback, ns->stalls,
+           ns->desynced ? ", DESYNCED" : "");
+    close(ns->sock);
+}
+
+// === 新增：无界面运行 (Headless) ===
+// 不开窗口、不初始化 SDL，按脚本给按键，跑固定的帧数，最后打印速度和状态哈希。
+// 用来做基准测试和 PGO 训练 (见 pgo.sh)。
+// 按键脚本：每行 "帧号 按键掩码(16进制)"，从这一帧开始按键变成这个掩码 (第 i 位 = 键 i)，
+// '#' 开头的是注释。没给脚本就用 --seed 生成的随机按键。
+#define INPUT_MAX_EVENTS 4096
+#define HEADLESS_CYCLES_PER_FRAME 10
+
+typedef struct {
+    uint32_t frame[INPUT_MAX_EVENTS];
+    uint16_t keys[INPUT_MAX_EVENTS];
+    int count;
+    uint32_t seed;  // count == 0 时用随机按键
+} InputScript;
+
+// 解析脚本的一行，注释和格式不对的行直接忽略
+void input_parse_line(InputScript *in, const char *line) {
+    unsigned frame, keys;
+    if (line[0] == '#' || sscanf(line, "%u %x", &frame, &keys) != 2) return;
+    if (in->count == INPUT_MAX_EVENTS) return;
+    in->frame[in->count] = frame;
+    in->keys[in->count] = (uint16_t)keys;
+    in->count++;
+}
+
+bool input_load(InputScript *in, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return false;
+    char line[128];
+    in->count = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        input_parse_line(in, line);
+    }
+    fclose(f);
+    return in->count > 0;
+}
+
+// 脚本已经读进内存了 (农场模式批量读文件)
+void input_parse(InputScript *in, const char *text, size_t len) {
+    char line[128];
+    in->count = 0;
+    while (len > 0) {
+        const char *nl = memchr(text, '\n', len);
+        size_t n = nl ? (size_t)(nl - text) : len;
+        snprintf(line, sizeof(line), "%.*s", (int)(n < sizeof(line) ? n : sizeof(line) - 1), text);
+        input_parse_line(in, line);
+        text += nl ? n + 1 : n;
+        len -= nl ? n + 1 : n;
+    }
+}
+
+// 第 frame 帧应该按着哪些键
+uint16_t input_keys_at(const InputScript *in, uint32_t frame) {
+    if (in->count == 0) {
+        // 随机按键：每 8 帧换一次，按住一会儿游戏才有反应
+        uint32_t h = fnv1a(2166136261u ^ in->seed, &(uint32_t){ frame / 8 }, sizeof(uint32_t));
+        return (uint16_t)(h & (h >> 16)); // 两次与一下，平均只按着 1/4 的键
+    }
+    uint16_t keys = 0;
+    for (int i = 0; i < in->count && in->frame[i] <= frame; ++i) keys = in->keys[i];
+    return keys;
+}
+
+void input_apply(const InputScript *in, Chip8 *cpu, uint32_t frame) {
+    uint16_t keys = input_keys_at(in, frame);
+    for (int k = 0; k < 16; ++k) cpu->key[k] = (keys >> k) & 1;
+}
+
+// 跑 frames 帧，返回跑了多少个周期
+uint64_t run_headless(Chip8 *cpu, uint32_t frames, const InputScript *in) {
+    uint64_t start = cpu->cycles;
+    for (uint32_t f = 0; f < frames; ++f) {
+        input_apply(in, cpu, f);
+        run_cycles(cpu, HEADLESS_CYCLES_PER_FRAME);
+        cpu->frame_ready = false;
+        cpu->draw_flag = false;
+    }
+    return cpu->cycles - start;
+}
+
+// 启动器里的每个 ROM 都从开机状态跑一遍
+int headless_main(Launcher *l, uint32_t frames, const InputScript *in) {
+    uint64_t total_cycles = 0;
+    double t_all = now_ms();
+    for (int i = 0; i < l->count; ++i) {
+        Chip8 cpu = l->slots[i].boot;
+        cpu.rng = in->seed; // 同样的脚本每次跑出来都一样
+        double t0 = now_ms();
+        uint64_t cycles = run_headless(&cpu, frames, in);
+        double ms = now_ms() - t0;
+        total_cycles += cycles;
+        printf("Headless: %s: %u frames, %llu cycles in %.1f ms (%.1f M cycles/s), state %08X%s\n",
+               l->slots[i].path, frames, (unsigned long long)cycles, ms,
+               ms > 0 ? cycles / ms / 1000.0 : 0.0, cpu_state_hash(&cpu),
+               cpu.fault ? " [fault]" : "");
+    }
+    double ms = now_ms() - t_all;
+    printf("Headless total: %d roms, %llu cycles in %.1f ms (%.1f M cycles/s)\n", l->count,
+           (unsigned long long)total_cycles, ms, ms > 0 ? total_cycles / ms / 1000.0 : 0.0);
+    return 0;
+}
+
+// === 新增：长时间浸泡测试 (Soak) ===
+// ./chip8 --soak 秒数 [--soak-interval 秒数] [--seed N] <rom | rom_dir | pack.c8pk>
+// 模拟器要能连着跑好几天：时间不能漂、内存不能涨、PC 不能跑飞。
+// 所有 ROM 轮流跑，每次 1 秒 (60 帧)，按键随机 (每个 ROM 自己的种子)；ROM 自己停机了就重新开机接着跑。
+// 每个检查点 (默认 10 秒一次)：
+//   - 所有实例的状态哈希合成一个记下来 (检查点按墙上时间打，两次浸泡跑的帧数不一样，哈希没法互相比)
+//   - 轮到的那个 ROM，从上个检查点的快照用同样的按键重放一遍，哈希对不上就是有不确定的地方
+//     (一次只重放一个 ROM，多花 1/ROM 个数 的时间，不算进吞吐量)
+//   - 记下这一段的吞吐量 (M cycles/s) 和 RSS (/proc/self/statm)
+// 每一帧都检查不变量 sp <= 16、pc < 4096 (停机了的不算：越界停机的 PC 本来就可能在外面)；
+// 最后打一份汇总，有问题返回 1。
+#define SOAK_CHUNK_FRAMES 60
+#define SOAK_INTERVAL_S 10
+#define SOAK_MAX_SAMPLES 100000 // 一天 8640 个检查点，够跑十来天
+
+typedef struct {
+    Chip8 cpu;
+    uint32_t seed;      // 随机按键的种子
+    uint32_t frame;     // 开机以来第几帧 (决定按哪些键)
+    Chip8 mark;         // 上个检查点的快照，重放用
+    uint32_t mark_frame;
+    uint32_t reboots;
+} SoakRun;
+
+typedef struct {
+    double t;           // 开始以来多少秒
+    double mcps;        // 这一段的 M cycles/s
+    long rss_kb;
+    uint32_t hash;
+} SoakSample;
+
+volatile sig_atomic_t soak_stop = 0;
+
+void soak_signal(int sig) {
+    (void)sig;
+    soak_stop = 1;
+}
+
+// 常驻内存 (KB)，读不到返回 -1
+long soak_rss_kb(void) {
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL) return -1;
+    long size, resident;
+    int n = fscanf(f, "%ld %ld", &size, &resident);
+    fclose(f);
+    return n == 2 ? resident * (sysconf(_SC_PAGESIZE) / 1024) : -1;
+}
+
+// 不变量：不成立说明模拟器自己出错了。ROM 的问题是 fault，停机了的 CPU 不检查。
+// 加固核心上 BNNN 或者 0xFFE 处的跳过会把 PC 弄到 4KB 外面，要到下一条指令才停机 (见 emulate_cycle)，
+// 这种也算已经停机了
+bool soak_invariants_ok(const Chip8 *cpu) {
+    if (cpu->fault != 0 || (cpu->hardened && cpu->pc + 1 >= 4096)) return true;
+    return cpu->sp <= 16 && cpu->pc < 4096;
+}
+
+// 跑 frames 帧，随机按键从开机后第 frame 帧起算。每帧后检查不变量，不成立就停下；
+// 返回跑了几帧
+int soak_run_frames(Chip8 *cpu, uint32_t seed, uint32_t frame, int frames) {
+    static InputScript in; // 没有脚本 (count == 0)，只用种子；几千个 ROM 共用一个，省得每个都带 24KB 的空表
+    in.seed = seed;
+    for (int f = 0; f < frames; ++f) {
+        input_apply(&in, cpu, frame + f);
+        run_cycles(cpu, HEADLESS_CYCLES_PER_FRAME);
+        cpu->frame_ready = false;
+        cpu->draw_flag = false;
+        if (!soak_invariants_ok(cpu)) return f + 1;
+    }
+    return frames;
+}
+
+int soak_main(Launcher *l, double seconds, double interval, uint32_t seed) {
+    SoakRun *runs = calloc(l->count, sizeof(SoakRun));
+    SoakSample *samples = malloc(SOAK_MAX_SAMPLES * sizeof(SoakSample));
+    if (runs == NULL || samples == NULL) {
+        printf("Error: out of memory\n");
+        free(runs);
+        free(samples);
+        return 1;
+    }
+    for (int i = 0; i < l->count; ++i) {
+        runs[i].seed = seed + 2u * i; // 每个 ROM 按的键不一样
+        runs[i].cpu = l->slots[i].boot;
+        runs[i].cpu.rng = runs[i].seed;
+        runs[i].cpu.quiet = true; // 停机了就重新开机，每次都打一行 "CPU fault" 太多了
+        runs[i].mark = runs[i].cpu;
+    }
+    signal(SIGINT, soak_signal);
+    signal(SIGTERM, soak_signal);
+    printf("Soak: %d roms for %.0f s, checkpoint every %.0f s (Ctrl-C stops early)\n", l->count, seconds, interval);
+
+    int nsamples = 0;
+    uint64_t total_cycles = 0, span_cycles = 0, faults = 0;
+    double run_ms = 0; // 不算重放的时间
+    int broken = 0, mismatches = 0, replay_next = 0;
+    long rss_start = soak_rss_kb();
+    double t0 = now_ms();
+    double t_span = t0;
+    while (!soak_stop) {
+        for (int i = 0; i < l->count && broken == 0; ++i) {
+            SoakRun *run = &runs[i];
+            uint64_t before = run->cpu.cycles;
+            run->frame += soak_run_frames(&run->cpu, run->seed, run->frame, SOAK_CHUNK_FRAMES);
+            span_cycles += run->cpu.cycles - before;
+            if (!soak_invariants_ok(&run->cpu)) {
+                printf("Soak: INVARIANT BROKEN in %s at frame %u: sp=%d pc=0x%04X cycle=%llu\n", l->slots[i].path,
+                       run->frame, run->cpu.sp, run->cpu.pc, (unsigned long long)run->cpu.cycles);
+                broken++;
+            } else if (run->cpu.fault != 0) {
+                // ROM 自己跑死了：换一组按键重新开机 (快照也跟着换，重放从开机算起)
+                faults++;
+                run->reboots++;
+                run->seed += 2u * l->count;
+                run->cpu = l->slots[i].boot;
+                run->cpu.rng = run->seed;
+                run->cpu.quiet = true;
+                run->frame = 0;
+                run->mark = run->cpu;
+                run->mark_frame = 0;
+            }
+        }
+        double now = now_ms();
+        bool done = broken > 0 || now - t0 >= seconds * 1000.0;
+        if (now - t_span < interval * 1000.0 && !done && !soak_stop) continue;
+
+        // 检查点
+        uint32_t h = 2166136261u;
+        for (int i = 0; i < l->count; ++i) {
+            uint32_t one = cpu_state_hash(&runs[i].cpu);
+            h = fnv1a(h, &one, sizeof(one));
+        }
+        // 重放一个 ROM (轮流来)，不算进吞吐量
+        double t_replay = now_ms();
+        SoakRun *run = &runs[replay_next];
+        Chip8 again = run->mark;
+        soak_run_frames(&again, run->seed, run->mark_frame, (int)(run->frame - run->mark_frame));
+        bool same = cpu_state_hash(&again) == cpu_state_hash(&run->cpu);
+        if (!same) {
+            mismatches++;
+            printf("Soak: REPLAY MISMATCH in %s, frames %u..%u\n", l->slots[replay_next].path, run->mark_frame,
+                   run->frame);
+        }
+        for (int i = 0; i < l->count; ++i) {
+            runs[i].mark = runs[i].cpu;
+            runs[i].mark_frame = runs[i].frame;
+        }
+        replay_next = (replay_next + 1) % l->count;
+
+        double span_ms = t_replay - t_span;
+        SoakSample sample = { (now - t0) / 1000.0, span_ms > 0 ? span_cycles / span_ms / 1000.0 : 0.0, soak_rss_kb(), h };
+        if (nsamples < SOAK_MAX_SAMPLES) samples[nsamples++] = sample;
+        run_ms += span_ms;
+        printf("Soak %8.0f s: %7.1f M cycles/s, rss %ld KB, state %08X, replay %s\n", sample.t, sample.mcps,
+               sample.rss_kb, h, same ? "ok" : "MISMATCH");
+        fflush(stdout);
+        total_cycles += span_cycles;
+        span_cycles = 0;
+        t_span = now_ms();
+        if (done) break;
+    }
+
+    // 汇总：吞吐量看最慢/最快和前后各 1/4 的平均 (掐头去尾容易受抖动影响)，RSS 看涨了多少
+    double secs = (now_ms() - t0) / 1000.0;
+    double lo = 1e30, hi = 0, head = 0, tail = 0;
+    int q = nsamples / 4 > 0 ? nsamples / 4 : 1;
+    long rss_peak = rss_start;
+    for (int k = 0; k < nsamples; ++k) {
+        if (samples[k].mcps < lo) lo = samples[k].mcps;
+        if (samples[k].mcps > hi) hi = samples[k].mcps;
+        if (k < q) head += samples[k].mcps / q;
+        if (k >= nsamples - q) tail += samples[k].mcps / q;
+        if (samples[k].rss_kb > rss_peak) rss_peak = samples[k].rss_kb;
+    }
+    long rss_end = nsamples > 0 ? samples[nsamples - 1].rss_kb : rss_start;
+    uint32_t reboots_max = 0;
+    for (int i = 0; i < l->count; ++i) {
+        if (runs[i].reboots > reboots_max) reboots_max = runs[i].reboots;
+    }
+    printf("Soak summary: %d roms, %.1f s, %llu cycles (%.1f M cycles/s), %d checkpoints\n", l->count, secs,
+           (unsigned long long)total_cycles, run_ms > 0 ? total_cycles / run_ms / 1000.0 : 0.0, nsamples);
+    if (nsamples > 0) {
+        printf("  throughput: min %.1f max %.1f, first quarter %.1f -> last quarter %.1f M cycles/s (%+.1f%%)\n", lo,
+               hi, head, tail, head > 0 ? (tail - head) * 100.0 / head : 0.0);
+    }
+    printf("  rss: start %ld KB, end %ld KB, peak %ld KB (%+ld KB)\n", rss_start, rss_end, rss_peak,
+           rss_end - rss_start);
+    printf("  rom faults (rebooted): %llu, most by one rom: %u\n", (unsigned long long)faults, reboots_max);
+    printf("  invariants (sp <= 16, pc < 4096): %s\n", broken ? "BROKEN" : "ok");
+    printf("  replay checks: %d, mismatches: %d\n", nsamples, mismatches);
+    printf("  final state %08X\n", nsamples > 0 ? samples[nsamples - 1].hash : 0);
+    free(runs);
+    free(samples);
+    return broken > 0 || mismatches > 0 ? 1 : 0;
+}
+
+// === 新增：农场模式 (批量跑一整个 ROM 目录) ===
+// ./chip8 --farm ROM目录 输出目录 [--headless 帧数] [--seed N] [--farm-fork N [--farm-timeout 毫秒]]
+// 目录里每个 xxx.ch8 是一个任务；有 xxx.keys 就用它当按键脚本，没有就用随机按键；
+// 有 xxx.pbm 就当作 "应该跑出来的最后一帧"，跑完对比，不一样的写一张 xxx.diff.pbm (异或出来的差别)。
+// 每个任务的最后一帧写成 输出目录/xxx.pbm，汇总写进 输出目录/results.tsv。
+//
+// 小文件成千上万，同步的 open/read/close 每个文件三次系统调用，瓶颈在系统调用不在磁盘。
+// 所以文件读写走 io_uring：一批 256 个文件，open 一次提交、read 一次提交、close 一次提交，
+// 读写用注册过的缓冲区 (READ_FIXED/WRITE_FIXED，内核不用每次去锁页)。
+// 老内核没有 io_uring (或者被禁用了) 就退回线程池，每个线程自己同步读写。
+//
+// --farm-fork N：不可信的 ROM (模糊测试生成的之类) 万一把模拟器弄崩/卡死，不能拖垮整个农场。
+// 这时不开工作线程，主线程同时开 (核数) 个子进程，每个跑 N 个任务 (N = 1 就是一个任务一个进程)。
+// 父进程早就准备好了 (没有 SDL，ROM 都读进内存了)，fork 出来直接就能跑；
+// 任务表放在共享内存里，子进程直接把结果写回去。子进程挂了，第一个没跑完的任务就是凶手，
+// 记下来，剩下的再 fork 一个接着跑；--farm-timeout 毫秒内一个任务都没跑完就当卡死，杀掉。
+#define FARM_BATCH 256
+#define FARM_SLOT 16384      // 每个文件一格缓冲，ROM 最多 3584 字节，按键脚本最多 16K
+#define PBM_SIZE (9 + 256)   // "P4\n64 32\n" + 64x32 个位
+#define FARM_TIMEOUT_MS 2000 // 隔离模式下一个任务最多跑多久
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434   // 老的头文件里没有
+#endif
+
+// 一个文件操作：读整个文件 / 写整个文件
+typedef struct {
+    const char *path;
+    bool write;
+    uint8_t *buf;      // 在 FarmIo 的 arena 里
+    uint32_t len;      // 写：写多少；读：最多读多少
+    int32_t result;    // 读写了多少字节，出错是 -errno
+    int fd;
+} FarmIoReq;
+
+// 手写的 io_uring (不依赖 liburing)
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size;
+    unsigned entries;
+} Uring;
+
+typedef struct {
+    bool uring_ok;
+    bool fixed;        // arena 注册成功了，可以用 READ_FIXED/WRITE_FIXED
+    Uring ring;
+    uint8_t *arena;    // FARM_BATCH 格，每格 FARM_SLOT 字节
+    int threads;       // 退回线程池的时候用几个线程
+    uint64_t syscalls; // 统计：一共进了几次内核 (只算文件操作)
+} FarmIo;
+
+// 拆掉 uring_init 建好的那些映射 (映射失败的是 MAP_FAILED，跳过)
+void uring_free(Uring *r) {
+    if (r->sqes != NULL && r->sqes != MAP_FAILED) munmap(r->sqes, r->entries * sizeof(struct io_uring_sqe));
+    if (r->cq_ring != NULL && r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring != NULL && r->sq_ring != MAP_FAILED) munmap(r->sq_ring, r->sq_ring_size);
+    close(r->fd); // 注册的缓冲区跟着一起释放
+}
+
+bool uring_init(Uring *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return false;
+
+    r->entries = p.sq_entries;
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size) r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = r->sq_ring_size;
+    }
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) goto fail;
+    }
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) goto fail;
+
+    uint8_t *sq = r->sq_ring, *cq = r->cq_ring;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+
+fail:
+    uring_free(r);
+    return false;
+}
+
+// 农场要用的操作内核都支持吗？io_uring 5.1 就有了，OPENAT/CLOSE/READ/WRITE 是 5.6 才加的，
+// 5.1~5.5 上 setup 能成功但每个 open 都失败。PROBE 本身也是 5.6 才有，问不出来就当不支持
+bool uring_supports_farm(Uring *r) {
+    static const uint8_t need[] = { IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_READ, IORING_OP_WRITE,
+                                    IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED };
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (probe == NULL) return false;
+    bool ok = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(need); ++i) {
+        ok = need[i] <= probe->last_op && (probe->ops[need[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return ok;
+}
+
+// 取一个空的 SQE (调用的人保证一批不超过环的大小)
+struct io_uring_sqe *uring_sqe(Uring *r) {
+    unsigned tail = *r->sq_tail;
+    unsigned i = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[i];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[i] = i;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+// 提交 n 个请求，等 n 个都完成，结果按 user_data 写进 res[]
+bool uring_run(FarmIo *io, int32_t *res, int n) {
+    Uring *r = &io->ring;
+    int done = 0;
+    // 内核可能只收下一部分 (比如一时分配不到内存)，这时它不等完成就返回了：
+    // 剩下的接着提交，不然永远等不到它们
+    for (int submitted = 0; submitted < n;) {
+        int got = (int)syscall(__NR_io_uring_enter, r->fd, n - submitted, n, IORING_ENTER_GETEVENTS, NULL, 0);
+        io->syscalls++;
+        if (got <= 0) return false;
+        submitted += got;
+    }
+    while (done < n) {
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (syscall(__NR_io_uring_enter, r->fd, 0, n - done, IORING_ENTER_GETEVENTS, NULL, 0) < 0) return false;
+            io->syscalls++;
+            continue;
+        }
+        for (; head != tail; ++head) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            res[cqe->user_data] = cqe->res;
+            done++;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+// io_uring 版本：open / read|write / close 各提交一次
+bool farm_io_uring_batch(FarmIo *io, FarmIoReq *reqs, int n) {
+    Uring *r = &io->ring;
+    int32_t res[FARM_BATCH];
+    for (int i = 0; i < n; ++i) {
+        struct io_uring_sqe *sqe = uring_sqe(r);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)reqs[i].path;
+        sqe->open_flags = reqs[i].write ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+        sqe->len = 0644;
+        sqe->user_data = i;
+        res[i] = -1;
+    }
+    if (!uring_run(io, res, n)) {
+        for (int i = 0; i < n; ++i) {
+            if (res[i] >= 0) close(res[i]); // 已经打开的别漏了
+        }
+        return false;
+    }
+
+    int m = 0;
+    for (int i = 0; i < n; ++i) {
+        reqs[i].fd = res[i];
+        reqs[i].result = res[i]; // 打不开的话这就是错误码
+        if (reqs[i].fd < 0) continue;
+        struct io_uring_sqe *sqe = uring_sqe(r);
+        if (io->fixed) {
+            sqe->opcode = reqs[i].write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe->buf_index = 0; // 整个 arena 注册成了一块
+        } else {
+            sqe->opcode = reqs[i].write ? IORING_OP_WRITE : IORING_OP_READ;
+        }
+        sqe->fd = reqs[i].fd;
+        sqe->addr = (uint64_t)(uintptr_t)reqs[i].buf;
+        sqe->len = reqs[i].len;
+        sqe->off = 0;
+        sqe->user_data = i;
+        m++;
+    }
+    if (m > 0 && !uring_run(io, res, m)) {
+        for (int i = 0; i < n; ++i) {
+            if (reqs[i].fd >= 0) close(reqs[i].fd);
+        }
+        return false;
+    }
+    for (int i = 0; i < n; ++i) {
+        if (reqs[i].fd >= 0) reqs[i].result = res[i];
+    }
+
+    // 关文件的结果不关心。res 先填一个 close 不会返回的值，环出了问题的话，
+    // 还是这个值的就是没关上的，自己关掉 (读写已经做完了，这一批照样算成功)
+    m = 0;
+    for (int i = 0; i < n; ++i) {
+        if (reqs[i].fd < 0) continue;
+        struct io_uring_sqe *sqe = uring_sqe(r);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = reqs[i].fd;
+        sqe->user_data = i;
+        res[i] = 1;
+        m++;
+    }
+    if (m > 0 && !uring_run(io, res, m)) {
+        for (int i = 0; i < n; ++i) {
+            if (reqs[i].fd >= 0 && res[i] == 1) close(reqs[i].fd);
+        }
+    }
+    return true;
+}
+
+// 线程池版本
+typedef struct {
+    FarmIoReq *reqs;
+    int n;
+    atomic_int next;
+} FarmIoWork;
+
+void *farm_io_thread(void *arg) {
+    FarmIoWork *w = arg;
+    int i;
+    while ((i = atomic_fetch_add(&w->next, 1)) < w->n) {
+        FarmIoReq *q = &w->reqs[i];
+        int fd = q->write ? open(q->path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : open(q->path, O_RDONLY);
+        if (fd < 0) {
+            q->result = -errno;
+            continue;
+        }
+        ssize_t got = q->write ? pwrite(fd, q->buf, q->len, 0) : pread(fd, q->buf, q->len, 0);
+        q->result = got < 0 ? -errno : (int32_t)got;
+        close(fd);
+    }
+    return NULL;
+}
+
+bool farm_io_pool_batch(FarmIo *io, FarmIoReq *reqs, int n) {
+    FarmIoWork w = { reqs, n, 0 };
+    pthread_t tid[64];
+    int t = 0;
+    for (; t < io->threads && t < 64; ++t) {
+        if (pthread_create(&tid[t], NULL, farm_io_thread, &w) != 0) break;
+    }
+    if (t == 0) farm_io_thread(&w);
+    for (int i = 0; i < t; ++i) pthread_join(tid[i], NULL);
+    io->syscalls += 3 * n;
+    return true;
+}
+
+bool farm_io_open(FarmIo *io, bool try_uring) {
+    memset(io, 0, sizeof(*io));
+    io->threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (io->threads < 1) io->threads = 1;
+    io->arena = aligned_alloc(4096, FARM_BATCH * FARM_SLOT);
+    if (io->arena == NULL) return false;
+    if (try_uring && uring_init(&io->ring, FARM_BATCH)) {
+        io->uring_ok = uring_supports_farm(&io->ring);
+        if (!io->uring_ok) uring_free(&io->ring);
+    }
+    if (io->uring_ok) {
+        struct iovec iov = { io->arena, FARM_BATCH * FARM_SLOT };
+        // 锁页内存的上限 (RLIMIT_MEMLOCK) 太小会失败，那就用普通的 READ/WRITE，照样是批量的
+        io->fixed = syscall(__NR_io_uring_register, io->ring.fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+    }
+    return true;
+}
+
+// 一批最多 FARM_BATCH 个，缓冲区必须是 arena 里的格子
+bool farm_io_batch(FarmIo *io, FarmIoReq *reqs, int n) {
+    if (n == 0) return true;
+    if (io->uring_ok && farm_io_uring_batch(io, reqs, n)) return true;
+    if (io->uring_ok) {
+        // 环出了问题 (里面可能还留着没收的完成事件)，后面的批次都不用它了
+        uring_free(&io->ring);
+        io->uring_ok = false;
+    }
+    return farm_io_pool_batch(io, reqs, n);
+}
+
+void farm_io_close(FarmIo *io) {
+    if (io->uring_ok) uring_free(&io->ring);
+    free(io->arena);
+}
+
+// 一个任务：一个 ROM (+ 按键脚本 + 期望的最后一帧)
+typedef struct {
+    char name[256];          // 不带 .ch8 的文件名
+    uint8_t *rom;
+    uint32_t rom_size;
+    char *keys;              // 按键脚本原文，没有就是 NULL
+    uint32_t keys_size;
+    uint8_t *expected;       // 期望的最后一帧 (PBM 的 256 字节)，没有就是 NULL
+    // 结果
+    bool loaded;
+    uint64_t cycles;
+    uint32_t state_hash;
+    uint8_t fault;
+    uint8_t frame[256];      // 最后一帧，每行 8 字节，高位在左 (和 PBM 一样)
+    int diff_pixels;         // 和期望的差几个像素，-1 表示没有期望
+    atomic_int status;       // FARM_JOB_xxx，子进程跑完最后写它 (父进程看它判断进度)
+    int signal;              // 子进程是被哪个信号弄死的
+} FarmJob;
+
+enum { FARM_JOB_PENDING, FARM_JOB_DONE, FARM_JOB_CRASHED, FARM_JOB_TIMEOUT };
+
+typedef struct {
+    FarmJob *jobs;
+    int count;
+    uint32_t frames;
+    uint32_t seed;
+    atomic_int next;
+    // --farm-fork
+    int fork_batch;          // 一个子进程跑几个任务，0 表示不隔离
+    int timeout_ms;
+    int children;            // 一共 fork 了几次
+    long long fork_ns;       // fork 花的时间 (父进程这边)
+} Farm;
+
+void pack_frame(const uint8_t *gfx, uint8_t *out) {
+    memset(out, 0, 256);
+    for (int i = 0; i < 2048; ++i) {
+        if (gfx[i]) out[i >> 3] |= 0x80 >> (i & 7);
+    }
+}
+
+// PBM (P4) 文件：64x32 黑白图，256 字节的位图数据跟在文件头后面
+bool parse_pbm(const uint8_t *data, int32_t size, uint8_t *out) {
+    if (size != PBM_SIZE || memcmp(data, "P4\n64 32\n", 9) != 0) return false;
+    memcpy(out, data + 9, 256);
+    return true;
+}
+
+void write_pbm(const uint8_t *frame, uint8_t *out) {
+    memcpy(out, "P4\n64 32\n", 9);
+    memcpy(out + 9, frame, 256);
+}
+
+void farm_run_job(Farm *farm, FarmJob *job) {
+    Chip8 cpu;
+    init_cpu(&cpu);
+    // ROM 没读进来 (读失败 / 太大) 的时候 rom 是 NULL，直接算加载失败
+    job->loaded = job->rom != NULL && load_rom_bytes(&cpu, job->rom, job->rom_size);
+    if (job->loaded) {
+        if (auto_quirks) quirks_auto(&cpu);
+        InputScript input = { .seed = farm->seed };
+        if (job->keys != NULL) input_parse(&input, job->keys, job->keys_size);
+        cpu.rng = farm->seed;
+        job->cycles = run_headless(&cpu, farm->frames, &input);
+        flush_display_list(&cpu);
+        job->state_hash = cpu_state_hash(&cpu);
+        job->fault = cpu.fault;
+        pack_frame(cpu.gfx, job->frame);
+        job->diff_pixels = -1;
+        if (job->expected != NULL) {
+            job->diff_pixels = 0;
+            for (int b = 0; b < 256; ++b) job->diff_pixels += __builtin_popcount(job->frame[b] ^ job->expected[b]);
+        }
+    }
+    atomic_store_explicit(&job->status, FARM_JOB_DONE, memory_order_release);
+}
+
+void *farm_worker(void *arg) {
+    Farm *farm = arg;
+    int i;
+    while ((i = atomic_fetch_add(&farm->next, 1)) < farm->count) {
+        farm_run_job(farm, &farm->jobs[i]);
+    }
+    return NULL;
+}
+
+// 隔离模式的一个子进程，跑 [first, end)
+typedef struct {
+    pid_t pid;   // 0 表示这一格空着
+    int pidfd;   // 老内核没有 pidfd_open 就是 -1
+    int first, end;
+    double last; // 上一次看到有任务跑完的时间
+} FarmChild;
+
+// fork 一个子进程跑 [first, end)，返回 false 表示开不了进程
+bool farm_spawn(Farm *farm, FarmChild *c, int first, int end) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid_t pid = fork();
+    if (pid == 0) {
+        for (int k = first; k < end; ++k) farm_run_job(farm, &farm->jobs[k]);
+        _exit(0); // 不能 exit：会把父进程没刷出去的 stdout 再刷一遍
+    }
+    if (pid < 0) return false;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    farm->fork_ns += (t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec);
+    farm->children++;
+    *c = (FarmChild){ pid, (int)syscall(SYS_pidfd_open, pid, 0), first, end, now_ms() };
+    return true;
+}
+
+// 隔离模式：主线程自己当管家，最多同时开 nslots 个子进程，每个跑一批 fork_batch 个任务。
+// fork 只在这一个线程里做，进程里没有别的线程：要是别的线程正拿着 malloc / stdio 的锁的时候 fork，
+// 子进程里 init_cpu、quirks_auto 一碰这些锁就永远等下去了。
+// 子进程挂了，第一个没跑完的任务就是凶手，剩下的再 fork 一个接着跑；
+// timeout_ms 内一个任务都没跑完就当卡死，杀掉。
+void farm_fork_supervise(Farm *farm, int nslots) {
+    FarmChild *kids = calloc(nslots, sizeof(FarmChild));
+    struct pollfd *pfds = calloc(nslots, sizeof(struct pollfd));
+    if (kids == NULL || pfds == NULL) nslots = 0; // 下面开不了子进程，全在本进程里跑
+    int next = 0, running = 0;
+    for (;;) {
+        // 1. 空出来的格子开新的一批
+        for (int k = 0; k < nslots && next < farm->count; ++k) {
+            if (kids[k].pid != 0) continue;
+            int end = next + farm->fork_batch < farm->count ? next + farm->fork_batch : farm->count;
+            if (farm_spawn(farm, &kids[k], next, end)) {
+                running++;
+            } else {
+                // 开不了进程：只能在本进程里跑，不隔离了
+                for (int i = next; i < end; ++i) farm_run_job(farm, &farm->jobs[i]);
+            }
+            next = end;
+        }
+        if (nslots == 0) {
+            for (; next < farm->count; ++next) farm_run_job(farm, &farm->jobs[next]);
+        }
+        if (running == 0 && next >= farm->count) break;
+
+        // 2. 等：都有 pidfd 就 poll 它们 (子进程一退出就醒)，不然隔一会儿 waitpid 看一眼
+        int npfd = 0;
+        for (int k = 0; k < nslots; ++k) {
+            if (kids[k].pid != 0 && kids[k].pidfd >= 0) pfds[npfd++] = (struct pollfd){ kids[k].pidfd, POLLIN, 0 };
+        }
+        if (npfd == running) {
+            poll(pfds, npfd, farm->timeout_ms < 100 ? farm->timeout_ms : 100);
+        } else {
+            usleep(200);
+        }
+
+        // 3. 看每个子进程：退出了没有、有没有进度、是不是卡死了
+        double now = now_ms();
+        for (int k = 0; k < nslots; ++k) {
+            FarmChild *c = &kids[k];
+            if (c->pid == 0) continue;
+            int status = 0;
+            bool exited = waitpid(c->pid, &status, WNOHANG) == c->pid;
+            int progress = c->first;
+            while (progress < c->end && atomic_load_explicit(&farm->jobs[progress].status, memory_order_acquire) == FARM_JOB_DONE) {
+                progress++;
+            }
+            bool hung = false;
+            if (!exited) {
+                if (progress > c->first) {
+                    c->first = progress;
+                    c->last = now;
+                    continue;
+                }
+                if (now - c->last < farm->timeout_ms) continue;
+                kill(c->pid, SIGKILL);
+                waitpid(c->pid, &status, 0);
+                hung = true;
+            }
+            if (c->pidfd >= 0) close(c->pidfd);
+            c->pid = 0;
+            running--;
+            if (progress < c->end) {
+                // 把子进程弄死 (或者卡住) 的任务记下来，后面的换个子进程接着跑
+                farm->jobs[progress].status = hung ? FARM_JOB_TIMEOUT : FARM_JOB_CRASHED;
+                farm->jobs[progress].signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+                int first = progress + 1, end = c->end;
+                if (first < end && farm_spawn(farm, c, first, end)) {
+                    running++;
+                } else {
+                    for (int i = first; i < end; ++i) farm_run_job(farm, &farm->jobs[i]);
+                }
+            }
+        }
+    }
+    free(kids);
+    free(pfds);
+}
+
+int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// 目录里有没有这个文件 (names 已经排好序)
+bool has_name(char **names, int n, const char *name) {
+    return bsearch(&name, names, n, sizeof(char *), compare_names) != NULL;
+}
+
+// 攒一批文件操作，满了就交给 farm_io_batch
+enum { FARM_ROM, FARM_KEYS, FARM_EXPECTED, FARM_OUTPUT };
+
+typedef struct {
+    FarmIoReq reqs[FARM_BATCH];
+    char paths[FARM_BATCH][4096];
+    int owner[FARM_BATCH];   // 哪个任务的
+    int kind[FARM_BATCH];    // FARM_xxx
+    int n;
+    uint64_t files, bytes, errors;
+} FarmBatch;
+
+char *copy_bytes(const uint8_t *data, int32_t size) {
+    char *out = malloc(size ? size : 1);
+    if (out != NULL) memcpy(out, data, size);
+    return out;
+}
+
+void farm_flush(FarmIo *io, FarmBatch *b, Farm *farm) {
+    farm_io_batch(io, b->reqs, b->n);
+    for (int q = 0; q < b->n; ++q) {
+        FarmJob *job = &farm->jobs[b->owner[q]];
+        int32_t size = b->reqs[q].result;
+        if (size < 0 || (b->kind[q] != FARM_OUTPUT && size >= FARM_SLOT)) {
+            b->errors++; // 读写失败，或者文件大得不像话
+            if (b->kind[q] == FARM_ROM) {
+                job->rom = NULL; // farm_run_job 看到 NULL 就记成 load_failed
+                job->rom_size = 0;
+            }
+            continue;
+        }
+        b->files++;
+        b->bytes += size;
+        if (b->kind[q] == FARM_ROM) {
+            job->rom = (uint8_t *)copy_bytes(b->reqs[q].buf, size);
+            job->rom_size = size;
+        } else if (b->kind[q] == FARM_KEYS) {
+            job->keys = copy_bytes(b->reqs[q].buf, size);
+            job->keys_size = size;
+        } else if (b->kind[q] == FARM_EXPECTED) {
+            uint8_t frame[256];
+            if (parse_pbm(b->reqs[q].buf, size, frame)) job->expected = (uint8_t *)copy_bytes(frame, 256);
+        }
+    }
+    b->n = 0;
+}
+
+// 加一个文件操作，返回它在 arena 里的缓冲区 (写的话调用的人往里填 len 个字节)
+uint8_t *farm_add(FarmIo *io, FarmBatch *b, Farm *farm, int owner, int kind, const char *path, uint32_t len) {
+    if (b->n == FARM_BATCH) farm_flush(io, b, farm);
+    int q = b->n++;
+    snprintf(b->paths[q], sizeof(b->paths[q]), "%s", path);
+    uint8_t *buf = io->arena + (size_t)q * FARM_SLOT;
+    b->reqs[q] = (FarmIoReq){ b->paths[q], kind == FARM_OUTPUT, buf, kind == FARM_OUTPUT ? len : FARM_SLOT, 0, -1 };
+    b->owner[q] = owner;
+    b->kind[q] = kind;
+    return buf;
+}
+
+int farm_main(const char *in_dir, const char *out_dir, uint32_t frames, uint32_t seed, bool try_uring,
+              int fork_batch, int timeout_ms) {
+    double t0 = now_ms();
+    rom_log = false;
+    cpu_log = false;
+
+    // 1. 列目录 (getdents 没法放进 io_uring，好在一次能拿很多项)
+    DIR *d = opendir(in_dir);
+    if (d == NULL) {
+        printf("Error: cannot open %s\n", in_dir);
+        return 1;
+    }
+    int nnames = 0, cap = 0;
+    char **names = NULL;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        if (nnames == cap) {
+            cap = cap ? cap * 2 : 1024;
+            names = realloc(names, cap * sizeof(char *));
+        }
+        names[nnames++] = strdup(ent->d_name);
+    }
+    closedir(d);
+    qsort(names, nnames, sizeof(char *), compare_names);
+    mkdir(out_dir, 0755);
+
+    static FarmIo io;
+    static FarmBatch batch;
+    if (!farm_io_open(&io, try_uring)) {
+        printf("Error: out of memory\n");
+        return 1;
+    }
+    // 读写缓冲区注册给了 io_uring (锁着页)，fork 的时候内核得把它整个拷一份；子进程用不着它
+    if (fork_batch > 0) madvise(io.arena, FARM_BATCH * FARM_SLOT, MADV_DONTFORK);
+
+    // 2. 每个 .ch8 一个任务，批量读它的 .ch8 / .keys / .pbm
+    // 隔离模式下任务表要和子进程共享 (子进程把结果直接写进来)
+    Farm farm = { NULL, 0, frames, seed, 0, fork_batch, timeout_ms, 0, 0 };
+    size_t jobs_size = (size_t)(nnames ? nnames : 1) * sizeof(FarmJob);
+    if (fork_batch > 0) {
+        farm.jobs = mmap(NULL, jobs_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (farm.jobs == MAP_FAILED) farm.jobs = NULL;
+    } else {
+        farm.jobs = calloc(1, jobs_size);
+    }
+    if (farm.jobs == NULL) {
+        printf("Error: out of memory\n");
+        return 1;
+    }
+    char path[4096], other[300];
+    for (int i = 0; i < nnames; ++i) {
+        size_t n = strlen(names[i]);
+        if (n < 4 || n - 4 >= sizeof(farm.jobs[0].name) || strcasecmp(names[i] + n - 4, ".ch8") != 0) continue;
+        int j = farm.count++;
+        FarmJob *job = &farm.jobs[j];
+        snprintf(job->name, sizeof(job->name), "%.*s", (int)(n - 4), names[i]);
+
+        static const char *ext[3] = { ".ch8", ".keys", ".pbm" };
+        for (int k = FARM_ROM; k <= FARM_EXPECTED; ++k) {
+            snprintf(other, sizeof(other), "%s%s", job->name, ext[k]);
+            if (k != FARM_ROM && !has_name(names, nnames, other)) continue;
+            snprintf(path, sizeof(path), "%s/%s", in_dir, other);
+            farm_add(&io, &batch, &farm, j, k, path, 0);
+        }
+    }
+    farm_flush(&io, &batch, &farm);
+    double t_ingest = now_ms();
+    uint64_t read_files = batch.files, read_bytes = batch.bytes, read_errors = batch.errors;
+    uint64_t read_syscalls = io.syscalls;
+
+    // 3. 所有核一起跑
+    int nthreads = io.threads;
+    pthread_t tid[64];
+    int started = 0;
+    if (fork_batch > 0) {
+        // 隔离模式不开工作线程，fork 只在主线程里做 (见 farm_fork_supervise)。
+        // 先做一次安全检查，那几张大表就分配好了，子进程直接继承
+        Chip8 warm;
+        init_cpu(&warm);
+        cpu_verify(&warm);
+        started = nthreads < 64 ? nthreads : 64;
+        farm_fork_supervise(&farm, started);
+    } else {
+        for (; started < nthreads && started < 64; ++started) {
+            if (pthread_create(&tid[started], NULL, farm_worker, &farm) != 0) break;
+        }
+        if (started == 0) farm_worker(&farm);
+        for (int i = 0; i < started; ++i) pthread_join(tid[i], NULL);
+    }
+    double t_run = now_ms();
+
+    // 4. 批量写：每个任务的最后一帧，和期望不一样的再写一张差异图
+    batch.files = batch.bytes = batch.errors = 0;
+    uint64_t cycles = 0;
+    int failed = 0, mismatched = 0, faulted = 0, crashed = 0, hung = 0;
+    for (int j = 0; j < farm.count; ++j) {
+        FarmJob *job = &farm.jobs[j];
+        if (job->status == FARM_JOB_CRASHED || job->status == FARM_JOB_TIMEOUT) {
+            if (job->status == FARM_JOB_CRASHED) crashed++;
+            else hung++;
+            continue;
+        }
+        if (!job->loaded) {
+            failed++;
+            continue;
+        }
+        cycles += job->cycles;
+        if (job->fault) faulted++;
+        snprintf(path, sizeof(path), "%s/%s.pbm", out_dir, job->name);
+        write_pbm(job->frame, farm_add(&io, &batch, &farm, j, FARM_OUTPUT, path, PBM_SIZE));
+        if (job->diff_pixels > 0) {
+            mismatched++;
+            uint8_t diff[256];
+            for (int b = 0; b < 256; ++b) diff[b] = job->frame[b] ^ job->expected[b];
+            snprintf(path, sizeof(path), "%s/%s.diff.pbm", out_dir, job->name);
+            write_pbm(diff, farm_add(&io, &batch, &farm, j, FARM_OUTPUT, path, PBM_SIZE));
+        }
+    }
+    farm_flush(&io, &batch, &farm);
+
+    // 汇总表只有一个文件，用普通的 stdio
+    snprintf(path, sizeof(path), "%s/results.tsv", out_dir);
+    FILE *f = fopen(path, "w");
+    if (f != NULL) {
+        fprintf(f, "name\trom_hash\tstate_hash\tcycles\tfault\tdiff_pixels\n");
+        for (int j = 0; j < farm.count; ++j) {
+            FarmJob *job = &farm.jobs[j];
+            if (job->status == FARM_JOB_CRASHED) {
+                fprintf(f, "%s\t%08X\t-\t-\tcrashed (%s)\t-\n", job->name, rom_hash(job->rom, job->rom_size),
+                        job->signal ? strsignal(job->signal) : "exited");
+                continue;
+            }
+            if (job->status == FARM_JOB_TIMEOUT) {
+                fprintf(f, "%s\t%08X\t-\t-\ttimeout\t-\n", job->name, rom_hash(job->rom, job->rom_size));
+                continue;
+            }
+            if (!job->loaded) {
+                fprintf(f, "%s\t-\t-\t-\tload_failed\t-\n", job->name);
+                continue;
+            }
+            fprintf(f, "%s\t%08X\t%08X\t%llu\t%s\t%d\n", job->name, rom_hash(job->rom, job->rom_size),
+                    job->state_hash, (unsigned long long)job->cycles, fault_names[job->fault], job->diff_pixels);
+        }
+        fclose(f);
+    }
+    double t_end = now_ms();
+
+    printf("Farm: %d jobs (%d failed to load, %d faulted, %d differ from expected), io: %s\n",
+           farm.count, failed, faulted, mismatched,
+           io.uring_ok ? (io.fixed ? "io_uring + registered buffers" : "io_uring") : "thread pool");
+    printf("  ingest  %8.1f ms  %llu files, %llu bytes, %llu errors, %llu io syscalls (%.0f files/s)\n",
+           t_ingest - t0, (unsigned long long)read_files, (unsigned long long)read_bytes,
+           (unsigned long long)read_errors, (unsigned long long)read_syscalls,
+           t_ingest > t0 ? read_files * 1000.0 / (t_ingest - t0) : 0.0);
+    printf("  run     %8.1f ms  %llu cycles on %d threads (%.1f M cycles/s)\n",
+           t_run - t_ingest, (unsigned long long)cycles, started ? started : 1,
+           t_run > t_ingest ? cycles / (t_run - t_ingest) / 1000.0 : 0.0);
+    printf("  output  %8.1f ms  %llu files, %llu errors\n", t_end - t_run,
+           (unsigned long long)batch.files, (unsigned long long)batch.errors);
+    if (fork_batch > 0) {
+        int children = farm.children;
+        printf("  isolation: %d children (%d jobs each), %d crashed, %d timed out, fork %.1f us per child / %.1f us per job\n",
+               children, fork_batch, crashed, hung,
+               children ? farm.fork_ns / 1000.0 / children : 0.0,
+               farm.count ? farm.fork_ns / 1000.0 / farm.count : 0.0);
+    }
+
+    for (int j = 0; j < farm.count; ++j) {
+        free(farm.jobs[j].rom);
+        free(farm.jobs[j].keys);
+        free(farm.jobs[j].expected);
+    }
+    if (fork_batch > 0) {
+        munmap(farm.jobs, jobs_size);
+    } else {
+        free(farm.jobs);
+    }
+    for (int i = 0; i < nnames; ++i) free(names[i]);
+    free(names);
+    farm_io_close(&io);
+    return 0;
+}
+
+// === 新增：ROM 静态扫描 (看整个 ROM 库都用了哪些指令和怪癖) ===
+// ./chip8 --scan ROM目录|包.c8pk 输出.tsv
+// 不运行 ROM，只从 0x200 顺着控制流把能走到的指令找出来 (数据区不算)，每个 ROM 一行：
+//   指令种类直方图、这个模拟器没实现但能走到的指令、可能依赖的怪癖、SUPER-CHIP / XO-CHIP 指令、代码大小。
+// 用来决定先实现哪些指令、先给哪些怪癖做快速路径。所有核一起扫。
+typedef struct {
+    ScanResult *results;
+    int count;
+    const Pack *pack;     // 扫包的时候用
+    atomic_int next;
+} ScanJob;
+
+void scan_free(ScanJob *job) {
+    if (job->pack == NULL) {
+        for (int i = 0; i < job->count; ++i) free(job->results[i].name);
+    }
+    free(job->results);
+}
+
+void *scan_worker(void *arg) {
+    ScanJob *job = arg;
+    int i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+        ScanResult *r = &job->results[i];
+        if (job->pack != NULL) {
+            const PackEntry *e = &job->pack->entries[i];
+            if (e->size <= 4096 - 512) scan_rom(job->pack->base + e->offset, e->size, r);
+            continue;
+        }
+        FILE *f = fopen(r->name, "rb");
+        if (f == NULL) continue;
+        uint8_t rom[4096 - 512];
+        size_t size = fread(rom, 1, sizeof(rom), f);
+        bool too_big = fgetc(f) != EOF;
+        fclose(f);
+        if (!too_big) scan_rom(rom, (uint32_t)size, r);
+    }
+    return NULL;
+}
+
+int scan_main(const char *src, const char *out_path) {
+    double t0 = now_ms();
+    ScanJob job = { NULL, 0, NULL, 0 };
+    size_t n = strlen(src);
+    if (n > 5 && strcmp(src + n - 5, ".c8pk") == 0) {
+        job.pack = pack_get(src);
+        if (job.pack == NULL) {
+            printf("Error: cannot open %s\n", src);
+            return 1;
+        }
+        job.count = (int)job.pack->header->count;
+        job.results = calloc(job.count ? job.count : 1, sizeof(ScanResult));
+        if (job.results == NULL) {
+            printf("Error: out of memory\n");
+            return 1;
+        }
+        for (int i = 0; i < job.count; ++i) {
+            job.results[i].name = (char *)job.pack->entries[i].name;
+        }
+    } else {
+        DIR *d = opendir(src);
+        if (d == NULL) {
+            printf("Error: cannot open %s\n", src);
+            return 1;
+        }
+        int cap = 0;
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL) {
+            size_t len = strlen(ent->d_name);
+            if (len < 4 || strcasecmp(ent->d_name + len - 4, ".ch8") != 0) continue;
+            if (job.count == cap) {
+                int bigger_cap = cap ? cap * 2 : 1024;
+                ScanResult *bigger = realloc(job.results, bigger_cap * sizeof(ScanResult));
+                if (bigger == NULL) break;
+                job.results = bigger;
+                cap = bigger_cap;
+            }
+            ScanResult *r = &job.results[job.count];
+            memset(r, 0, sizeof(*r));
+            size_t path_len = strlen(src) + 1 + len + 1;
+            if ((r->name = malloc(path_len)) == NULL) break;
+            snprintf(r->name, path_len, "%s/%s", src, ent->d_name);
+            job.count++;
+        }
+        closedir(d);
+        if (ent != NULL) {
+            printf("Error: out of memory after %d ROMs\n", job.count);
+            scan_free(&job);
+            return 1;
+        }
+    }
+
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t tid[64];
+    int started = 0;
+    for (; started < nthreads && started < 64; ++started) {
+        if (pthread_create(&tid[started], NULL, scan_worker, &job) != 0) break;
+    }
+    if (started == 0) scan_worker(&job);
+    for (int i = 0; i < started; ++i) pthread_join(tid[i], NULL);
+    double t_scan = now_ms();
+
+    FILE *f = fopen(out_path, "w");
+    if (f == NULL) {
+        printf("Error: cannot write %s\n", out_path);
+        scan_free(&job);
+        return 1;
+    }
+    // 表头：固定的几列 + 每种指令一列
+    fprintf(f, "name\tsize\thash\tinstructions\tcode_bytes\tcode_span\tschip\txochip\tindirect\tunimplemented\tquirks");
+    for (int k = 0; k < OP_KINDS; ++k) fprintf(f, "\t%s", op_kinds[k].name);
+    fprintf(f, "\tinvalid\n");
+
+    // 汇总：全库有多少个 ROM 会碰到每种没实现的指令 / 每种怪癖
+    uint32_t roms_hitting[OP_KINDS + 1] = { 0 }, quirk_roms[QUIRK_COUNT] = { 0 };
+    int scanned = 0, schip = 0, xochip = 0;
+    for (int i = 0; i < job.count; ++i) {
+        ScanResult *r = &job.results[i];
+        if (!r->ok) continue;
+        scanned++;
+        if (r->families & 1) schip++;
+        if (r->families & 2) xochip++;
+        fprintf(f, "%s\t%u\t%08X\t%u\t%u\t%u\t%d\t%d\t%d\t", r->name, r->size, r->hash, r->reachable,
+                r->reachable * 2, r->hi > r->lo ? r->hi - r->lo : 0,
+                (r->families & 1) != 0, (r->families & 2) != 0, r->indirect);
+        bool first = true;
+        for (int k = 0; k <= OP_KINDS; ++k) {
+            if (r->hist[k] == 0 || (k < OP_KINDS && op_kinds[k].implemented)) continue;
+            fprintf(f, "%s%s", first ? "" : ",", k < OP_KINDS ? op_kinds[k].name : "invalid");
+            roms_hitting[k]++;
+            first = false;
+        }
+        if (first) fprintf(f, "-");
+        fprintf(f, "\t");
+        first = true;
+        for (int q = 0; q < QUIRK_COUNT; ++q) {
+            if (!(r->quirks & (1 << q))) continue;
+            fprintf(f, "%s%s", first ? "" : ",", quirk_names[q]);
+            quirk_roms[q]++;
+            first = false;
+        }
+        if (first) fprintf(f, "-");
+        for (int k = 0; k <= OP_KINDS; ++k) fprintf(f, "\t%u", r->hist[k]);
+        fprintf(f, "\n");
+    }
+    fclose(f);
+
+    printf("Scan: %d ROMs (%d unreadable) in %.1f ms on %d threads -> %s\n", scanned, job.count - scanned,
+           t_scan - t0, started ? started : 1, out_path);
+    printf("  SUPER-CHIP: %d, XO-CHIP: %d\n", schip, xochip);
+    printf("  unimplemented opcodes by number of ROMs that reach them:\n");
+    for (;;) {
+        int best = -1;
+        for (int k = 0; k <= OP_KINDS; ++k) {
+            if (roms_hitting[k] > 0 && (best < 0 || roms_hitting[k] > roms_hitting[best])) best = k;
+        }
+        if (best < 0) break;
+        printf("    %-8s %u\n", best < OP_KINDS ? op_kinds[best].name : "invalid", roms_hitting[best]);
+        roms_hitting[best] = 0;
+    }
+    printf("  quirks:");
+    for (int q = 0; q < QUIRK_COUNT; ++q) printf(" %s=%u", quirk_names[q], quirk_roms[q]);
+    printf("\n");
+    scan_free(&job);
+    return 0;
+}
+
+// === 新增：服务模式 (Unix 域套接字，别的进程来驱动模拟器) ===
+// ./chip8 --serve /tmp/chip8.sock
+// 一个进程里放很多个 Chip8 实例，客户端用二进制协议操作。
+// 请求 = 12 字节头 + len 字节数据，回复 = 8 字节头 + len 字节数据，都是小端：
+//   请求头: op(1) pad(1) inst(2) arg(4) len(4)
+//   回复头: status(1) op(1) inst(2) len(4)
+// op:
+//   SERVE_CREATE   新建实例，回复头里的 inst 就是新实例的编号 (arg 是随机数种子，0 表示随便)
+//   SERVE_LOAD     数据是 ROM 内容，装进实例 (重新开机)
+//   SERVE_STEP     跑 arg 帧 (每帧 10 个周期)，一次最多 SERVE_MAX_STEP 帧，多了回 SERVE_BAD_OP
+//   SERVE_KEYS     arg 的低 16 位是按键掩码
+//   SERVE_FRAME    回复 256 字节的画面 (每行 8 字节，高位在左)
+//   SERVE_SAVE / SERVE_RESTORE  存/读实例自己的一个快照
+//   SERVE_DESTROY  删掉实例
+// 实例只能由建它的那个客户端操作，别人的实例一律回 SERVE_BAD_INSTANCE。
+// 客户端可以一口气发很多请求不等回复 (流水线)：服务端一次 read 读进来多少就处理多少，
+// 回复攒起来用一次 writev 发出去，画面数据直接指向实例里打包好的缓冲区，不再拷一遍。
+#define SERVE_MAX_INSTANCES 1024
+#define SERVE_MAX_CLIENTS 64
+#define SERVE_BUF (64 * 1024)
+#define SERVE_IOV 256 // 一次 writev 最多几段 (IOV_MAX 一般是 1024)
+#define SERVE_MAX_STEP 3600 // 一个 SERVE_STEP 最多跑几帧 (一分钟)，不然一个请求就能把别的客户端卡住
+
+enum { SERVE_CREATE = 1, SERVE_LOAD, SERVE_STEP, SERVE_KEYS, SERVE_FRAME, SERVE_SAVE, SERVE_RESTORE, SERVE_DESTROY };
+enum { SERVE_OK = 0, SERVE_BAD_OP, SERVE_BAD_INSTANCE, SERVE_FULL, SERVE_BAD_ROM, SERVE_NO_SNAPSHOT };
+
+typedef struct __attribute__((packed)) {
+    uint8_t op;
+    uint8_t pad;
+    uint16_t inst;
+    uint32_t arg;
+    uint32_t len;
+} ServeRequest;
+
+typedef struct __attribute__((packed)) {
+    uint8_t status;
+    uint8_t op;
+    uint16_t inst;
+    uint32_t len;
+} ServeReply;
+
+typedef struct {
+    Chip8 cpu;
+    Chip8 snapshot;
+    bool has_snapshot;
+    int owner;            // 哪个客户端建的，断开的时候一起删掉
+    uint8_t frame[256];   // SERVE_FRAME 打包好的画面，writev 直接发这里
+    bool frame_queued;    // frame 已经在待发送的回复里了，不能再改
+} ServeInstance;
+
+typedef struct {
+    int fd;
+    uint8_t in[SERVE_BUF];
+    size_t in_len;
+    // 待发送的回复
+    ServeReply replies[SERVE_IOV];
+    struct iovec iov[SERVE_IOV];
+    int nreplies, niov;
+    ServeInstance *queued[SERVE_IOV]; // 哪些实例的画面在待发送的回复里
+    int nqueued;
+} ServeClient;
+
+typedef struct {
+    ServeInstance *instances[SERVE_MAX_INSTANCES];
+    ServeClient *clients[SERVE_MAX_CLIENTS];
+    uint64_t requests, writevs;
+} Server;
+
+bool serve_flush(Server *sv, ServeClient *c) {
+    struct iovec *iov = c->iov;
+    int n = c->niov;
+    while (n > 0) {
+        ssize_t sent = writev(c->fd, iov, n);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        sv->writevs++;
+        // 没发完 (套接字缓冲满了)：跳过已经发出去的部分接着发
+        while (n > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    c->nreplies = c->niov = 0;
+    for (int i = 0; i < c->nqueued; ++i) c->queued[i]->frame_queued = false;
+    c->nqueued = 0;
+    return true;
+}
+
+// 攒一个回复；data 必须活到下次 flush (指向实例里的 frame)
+bool serve_reply(Server *sv, ServeClient *c, uint8_t status, uint8_t op, uint16_t inst, const void *data, uint32_t len) {
+    if (c->nreplies == SERVE_IOV || c->niov + 2 > SERVE_IOV) {
+        if (!serve_flush(sv, c)) return false;
+    }
+    ServeReply *r = &c->replies[c->nreplies++];
+    *r = (ServeReply){ status, op, inst, len };
+    c->iov[c->niov++] = (struct iovec){ r, sizeof(*r) };
+    if (len > 0) c->iov[c->niov++] = (struct iovec){ (void *)data, len };
+    return true;
+}
+
+bool serve_request(Server *sv, int client, ServeClient *c, const ServeRequest *q, const uint8_t *data) {
+    sv->requests++;
+    ServeInstance *in = q->inst < SERVE_MAX_INSTANCES ? sv->instances[q->inst] : NULL;
+    if (q->op != SERVE_CREATE && (in == NULL || in->owner != client)) {
+        return serve_reply(sv, c, SERVE_BAD_INSTANCE, q->op, q->inst, NULL, 0);
+    }
+    switch (q->op) {
+        case SERVE_CREATE:
+            for (int i = 0; i < SERVE_MAX_INSTANCES; ++i) {
+                if (sv->instances[i] != NULL) continue;
+                in = calloc(1, sizeof(ServeInstance));
+                if (in == NULL) break;
+                init_cpu(&in->cpu);
+                if (q->arg != 0) in->cpu.rng = q->arg | 1;
+                in->owner = client;
+                sv->instances[i] = in;
+                return serve_reply(sv, c, SERVE_OK, q->op, (uint16_t)i, NULL, 0);
+            }
+            return serve_reply(sv, c, SERVE_FULL, q->op, 0, NULL, 0);
+
+        case SERVE_LOAD: {
+            uint32_t rng = in->cpu.rng;
+            init_cpu(&in->cpu);
+            in->cpu.rng = rng;
+            bool ok = load_rom_bytes(&in->cpu, data, q->len);
+            if (ok && auto_quirks) quirks_auto(&in->cpu);
+            return serve_reply(sv, c, ok ? SERVE_OK : SERVE_BAD_ROM, q->op, q->inst, NULL, 0);
+        }
+
+        case SERVE_STEP:
+            if (q->arg > SERVE_MAX_STEP) return serve_reply(sv, c, SERVE_BAD_OP, q->op, q->inst, NULL, 0);
+            for (uint32_t f = 0; f < q->arg; ++f) {
+                run_cycles(&in->cpu, HEADLESS_CYCLES_PER_FRAME);
+            }
+            in->cpu.frame_ready = false;
+            in->cpu.draw_flag = false;
+            return serve_reply(sv, c, SERVE_OK, q->op, q->inst, NULL, 0);
+
+        case SERVE_KEYS:
+            for (int k = 0; k < 16; ++k) in->cpu.key[k] = (q->arg >> k) & 1;
+            return serve_reply(sv, c, SERVE_OK, q->op, q->inst, NULL, 0);
+
+        case SERVE_FRAME:
+            // 同一批里已经要发这个实例的画面了，先发掉再改
+            if (in->frame_queued && !serve_flush(sv, c)) return false;
+            // (serve_reply 满了会先 flush，所以先回复再登记)
+            pack_frame(in->cpu.gfx, in->frame);
+            if (!serve_reply(sv, c, SERVE_OK, q->op, q->inst, in->frame, sizeof(in->frame))) return false;
+            in->frame_queued = true;
+            c->queued[c->nqueued++] = in;
+            return true;
+
+        case SERVE_SAVE:
+            in->snapshot = in->cpu;
+            in->has_snapshot = true;
+            return serve_reply(sv, c, SERVE_OK, q->op, q->inst, NULL, 0);
+
+        case SERVE_RESTORE:
+            if (!in->has_snapshot) return serve_reply(sv, c, SERVE_NO_SNAPSHOT, q->op, q->inst, NULL, 0);
+            in->cpu = in->snapshot;
+            return serve_reply(sv, c, SERVE_OK, q->op, q->inst, NULL, 0);
+
+        case SERVE_DESTROY:
+            if (in->frame_queued && !serve_flush(sv, c)) return false;
+            free(in);
+            sv->instances[q->inst] = NULL;
+            return serve_reply(sv, c, SERVE_OK, q->op, q->inst, NULL, 0);
+
+        default:
+            return serve_reply(sv, c, SERVE_BAD_OP, q->op, q->inst, NULL, 0);
+    }
+}
+
+// 把读进来的完整请求都处理掉，剩半个的留到下次
+bool serve_client(Server *sv, int client) {
+    ServeClient *c = sv->clients[client];
+    ssize_t got = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+    if (got <= 0) return got < 0 && errno == EINTR;
+    c->in_len += got;
+
+    size_t pos = 0;
+    while (c->in_len - pos >= sizeof(ServeRequest)) {
+        ServeRequest q;
+        memcpy(&q, c->in + pos, sizeof(q));
+        if (q.len > SERVE_BUF - sizeof(ServeRequest)) return false; // 不可能放得下，协议错了
+        if (c->in_len - pos < sizeof(q) + q.len) break;
+        if (!serve_request(sv, client, c, &q, c->in + pos + sizeof(q))) return false;
+        pos += sizeof(q) + q.len;
+    }
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+    return serve_flush(sv, c);
+}
+
+void serve_drop(Server *sv, int client) {
+    ServeClient *c = sv->clients[client];
+    // flush 失败就走到这里了：待发送的画面不会再发，登记的标记要清掉
+    for (int i = 0; i < c->nqueued; ++i) c->queued[i]->frame_queued = false;
+    c->nqueued = 0;
+    for (int i = 0; i < SERVE_MAX_INSTANCES; ++i) {
+        if (sv->instances[i] != NULL && sv->instances[i]->owner == client) {
+            free(sv->instances[i]);
+            sv->instances[i] = NULL;
+        }
+    }
+    close(c->fd);
+    free(c);
+    sv->clients[client] = NULL;
+}
+
+volatile sig_atomic_t serve_stop = 0;
+
+void serve_signal(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+int serve_main(const char *sock_path) {
+    cpu_log = false;
+    rom_log = false;
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path);
+    unlink(sock_path);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, 16) != 0) {
+        printf("Error: cannot listen on %s\n", sock_path);
+        if (lfd >= 0) close(lfd);
+        return 1;
+    }
+    signal(SIGINT, serve_signal);
+    signal(SIGTERM, serve_signal);
+    signal(SIGPIPE, SIG_IGN); // 客户端跑了，writev 返回错误就行，别把服务弄死
+    printf("Serving on %s\n", sock_path);
+
+    static Server sv;
+    double t0 = now_ms();
+    while (!serve_stop) {
+        struct pollfd fds[SERVE_MAX_CLIENTS + 1];
+        int who[SERVE_MAX_CLIENTS + 1];
+        int n = 0;
+        fds[n] = (struct pollfd){ lfd, POLLIN, 0 };
+        who[n++] = -1;
+        for (int i = 0; i < SERVE_MAX_CLIENTS; ++i) {
+            if (sv.clients[i] == NULL) continue;
+            fds[n] = (struct pollfd){ sv.clients[i]->fd, POLLIN, 0 };
+            who[n++] = i;
+        }
+        if (poll(fds, n, 1000) <= 0) continue;
+
+        for (int k = 1; k < n; ++k) {
+            if (fds[k].revents == 0) continue;
+            if (!serve_client(&sv, who[k])) serve_drop(&sv, who[k]);
+        }
+        if (fds[0].revents & POLLIN) {
+            int cfd = accept(lfd, NULL, NULL);
+            int slot = 0;
+            while (slot < SERVE_MAX_CLIENTS && sv.clients[slot] != NULL) slot++;
+            if (cfd >= 0 && slot < SERVE_MAX_CLIENTS && (sv.clients[slot] = calloc(1, sizeof(ServeClient))) != NULL) {
+                sv.clients[slot]->fd = cfd;
+            } else if (cfd >= 0) {
+                close(cfd);
+            }
+        }
+    }
+
+    double s = (now_ms() - t0) / 1000.0;
+    printf("Serve: %llu requests, %llu writev calls in %.1f s\n",
+           (unsigned long long)sv.requests, (unsigned long long)sv.writevs, s);
+    for (int i = 0; i < SERVE_MAX_CLIENTS; ++i) {
+        if (sv.clients[i] != NULL) serve_drop(&sv, i);
+    }
+    close(lfd);
+    unlink(sock_path);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    srand(time(NULL)); // <--- 加这行，初始化随机数种子
+
+    // 命令行参数：[--grid N] [--filter scale2x|scale3x|scale4x|xbr]
+    //             [--watch EXPR]... [--break EXPR]...
+    //             [--net 1|2 LOCAL_PORT PEER_IP:PORT [--net-delay MS] [--net-loss PCT] [--seed N]]
+    //             [--audio | --audio-sync] [--jit] [--prof] [--quirks auto|default|chip8|schip|xochip|HEX]
+    //             [--journal [STEPS]]
+    //             [--headless FRAMES [--input KEYS_FILE] [--seed N]] <rom | rom_dir | pack.c8pk[:name | :#hash]>
+    //       ./chip8 --pack ROM_DIR OUT.c8pk
+    //       ./chip8 --farm ROM_DIR OUT_DIR [--headless FRAMES] [--seed N] [--farm-threads-io]
+    //                      [--farm-fork JOBS_PER_CHILD [--farm-timeout MS]]
+    //       ./chip8 --serve SOCKET_PATH
+    //       ./chip8 --scan ROM_DIR|PACK.c8pk OUT.tsv
+    //       ./chip8 --soak SECONDS [--soak-interval SECONDS] [--seed N] <rom | rom_dir | pack.c8pk>
+    int grid = 0;
+    int net_player = 0, net_port = 0, net_delay = 0, net_loss = 0;
+    const char *net_peer = NULL;
+    uint32_t seed = 1;
+    bool audio_on = false, audio_sync = false;
+    bool jit_on = false;
+    bool prof_on = false;
+    int journal_steps = 0; // 0 表示不记撤销日志
+    uint32_t headless = 0;
+    double soak_s = 0, soak_interval = SOAK_INTERVAL_S;
+    const char *input_path = NULL;
+    const char *pack_dir = NULL, *pack_out = NULL;
+    const char *farm_in = NULL, *farm_out = NULL;
+    bool farm_uring = true;
+    int farm_fork = 0, farm_timeout = FARM_TIMEOUT_MS;
+    const char *serve_path = NULL;
+    const char *scan_src = NULL, *scan_out = NULL;
+    static Watch watches[16];
+    int nwatches = 0;
+    Filter filter = FILTER_NONE;
+    const char *rom_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            grid = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "scale2x") == 0) filter = FILTER_SCALE2X;
+            else if (strcmp(name, "scale3x") == 0) filter = FILTER_SCALE3X;
+            else if (strcmp(name, "scale4x") == 0) filter = FILTER_SCALE4X;
+            else if (strcmp(name, "xbr") == 0) filter = FILTER_XBR;
+            else printf("Unknown filter: %s\n", name);
+        } else if (strcmp(argv[i], "--net") == 0 && i + 3 < argc) {
+            net_player = atoi(argv[++i]);
+            net_port = atoi(argv[++i]);
+            net_peer = argv[++i];
+        } else if (strcmp(argv[i], "--net-delay") == 0 && i + 1 < argc) {
+            net_delay = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--net-loss") == 0 && i + 1 < argc) {
+            net_loss = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--audio") == 0) {
+            audio_on = true;
+        } else if (strcmp(argv[i], "--audio-sync") == 0) {
+            audio_on = audio_sync = true;
+        } else if (strcmp(argv[i], "--soak") == 0 && i + 1 < argc) {
+            soak_s = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--soak-interval") == 0 && i + 1 < argc) {
+            soak_interval = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            headless = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (strcmp(argv[i], "--farm") == 0 && i + 2 < argc) {
+            farm_in = argv[++i];
+            farm_out = argv[++i];
+        } else if (strcmp(argv[i], "--scan") == 0 && i + 2 < argc) {
+            scan_src = argv[++i];
+            scan_out = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if (strcmp(argv[i], "--farm-threads-io") == 0) {
+            farm_uring = false; // 不用 io_uring，测线程池那条路
+        } else if (strcmp(argv[i], "--farm-fork") == 0 && i + 1 < argc) {
+            farm_fork = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--farm-timeout") == 0 && i + 1 < argc) {
+            farm_timeout = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pack") == 0 && i + 2 < argc) {
+            pack_dir = argv[++i];
+            pack_out = argv[++i];
+        } else if (strcmp(argv[i], "--prof") == 0) {
+            prof_on = true;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            jit_on = true;
+        } else if (strcmp(argv[i], "--journal") == 0) {
+            // 步数可以不写：后面跟的是数字才当步数
+            journal_steps = JOURNAL_STEPS;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') journal_steps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            if (!quirks_parse(argv[++i])) {
+                printf("Unknown quirks: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 0) | 1;
+        } else if ((strcmp(argv[i], "--watch") == 0 || strcmp(argv[i], "--break") == 0) && i + 1 < argc) {
+            bool is_break = strcmp(argv[i], "--break") == 0;
+            if (nwatches == 16) { printf("Too many watches\n"); return 1; }
+            if (!watch_compile(&watches[nwatches], argv[++i], is_break)) return 1;
+            nwatches++;
+        } else {
+            rom_path = argv[i];
+        }
+    }
+    // 打包工具：ROM 目录 -> .c8pk
+    if (pack_dir != NULL) {
+        int n = pack_build(pack_dir, pack_out);
+        if (n < 0) {
+            printf("Error: cannot pack %s into %s\n", pack_dir, pack_out);
+            return 1;
+        }
+        printf("Packed %d ROMs into %s\n", n, pack_out);
+        return 0;
+    }
+    // 农场：整个目录批量跑，默认每个 ROM 跑 10 秒 (600 帧)
+    if (farm_in != NULL) {
+        return farm_main(farm_in, farm_out, headless ? headless : 600, seed, farm_uring, farm_fork, farm_timeout);
+    }
+    // 静态扫描：不运行 ROM
+    if (scan_src != NULL) {
+        return scan_main(scan_src, scan_out);
+    }
+    // 服务模式：不需要 ROM 参数，ROM 由客户端发过来
+    if (serve_path != NULL) {
+        return serve_main(serve_path);
+    }
+    if (rom_path == NULL) {
+        printf("Usage: ./chip8 [--grid N] [--filter scale2x|scale3x|scale4x|xbr] [--watch EXPR] [--break EXPR]\n"
+               "               [--net 1|2 LOCAL_PORT PEER_IP:PORT [--net-delay MS] [--net-loss PCT] [--seed N]]\n"
+               "               [--audio | --audio-sync] [--jit] [--prof] [--quirks auto|default|chip8|schip|xochip|HEX]\n"
+               "               [--journal [STEPS]]\n"
+               "               [--headless FRAMES [--input KEYS_FILE] [--seed N]] <rom | rom_dir | pack.c8pk[:name | :#hash]>\n"
+               "       ./chip8 --pack ROM_DIR OUT.c8pk\n"
+               "       ./chip8 --farm ROM_DIR OUT_DIR [--headless FRAMES] [--seed N] [--farm-threads-io]\n"
+               "                      [--farm-fork JOBS_PER_CHILD [--farm-timeout MS]]\n"
+               "       ./chip8 --serve SOCKET_PATH\n"
+               "       ./chip8 --scan ROM_DIR|PACK.c8pk OUT.tsv\n"
+               "       ./chip8 --soak SECONDS [--soak-interval SECONDS] [--seed N] <rom | rom_dir | pack.c8pk>\n");
+        return 1;
+    }
+
+    // 无界面模式：不碰 SDL，加载完就跑
+    if (headless > 0 || soak_s > 0) {
+        static InputScript input;
+        input.seed = seed;
+        if (input_path != NULL && !input_load(&input, input_path)) {
+            printf("Error: cannot read input script %s\n", input_path);
+            return 1;
+        }
+        cpu_log = false;
+        Launcher launcher = { 0 };
+        RomLoadJob job = { &launcher, rom_path, false, 0 };
+        rom_load_thread(&job);
+        if (!job.ok) {
+            printf("Failed to load ROM\n");
+            launcher_free(&launcher);
+            return 1;
+        }
+        static Jit jit;
+        if (jit_on && jit_open(&jit)) cpu_jit = &jit;
+        int rc = soak_s > 0 ? soak_main(&launcher, soak_s, soak_interval, seed)
+                            : headless_main(&launcher, headless, &input);
+        if (cpu_jit != NULL) jit_close(cpu_jit);
+        launcher_free(&launcher);
+        return rc;
+    }
+
+    double t_start = now_ms();
+
+    // === 后台加载 ROM ===
+    // SDL 的窗口/渲染器只能在主线程创建，所以反过来：把 ROM 加载丢到后台线程
+    Launcher launcher = { 0 };
+    RomLoadJob job = { &launcher, rom_path, false, 0 };
+    pthread_t loader;
+    bool threaded = pthread_create(&loader, NULL, rom_load_thread, &job) == 0;
+    if (!threaded) rom_load_thread(&job); // 开不了线程就同步加载
 
     // === SDL 初始化 ===
+    // 只初始化视频 (事件系统会跟着一起起来)，别的子系统用到再说
+    double t0 = now_ms();
     SDL_Init(SDL_INIT_VIDEO);
+    double t_init = now_ms();
     // 放大 10 倍显示，方便看清
     SDL_Window *window = SDL_CreateWindow("CHIP-8", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 640, 320, SDL_WINDOW_SHOWN);
+    double t_window = now_ms();
     SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
-    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 64, 32);
+    double t_renderer = now_ms();
+    // 开了放大滤镜的话，纹理直接就是放大后的尺寸
+    int scale = filter_scale(filter);
+    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 64 * scale, 32 * scale);
+    double t_texture = now_ms();
+
+    // 窗口一出来就先交一帧黑屏，不用等 ROM 跑起来
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    SDL_RenderPresent(renderer);
+    double t_first_frame = now_ms();
+
+    if (threaded) pthread_join(loader, NULL);
+    if (!job.ok) {
+        printf("Failed to load ROM\n");
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        launcher_free(&launcher);
+        return 1;
+    }
+
+    printf("Startup: rom %.1f ms | SDL_Init %.1f ms | window %.1f ms | renderer %.1f ms | texture %.1f ms | first frame @ %.1f ms\n",
+           job.ms, t_init - t0, t_window - t_init, t_renderer - t_window,
+           t_texture - t_renderer, t_first_frame - t_start);
+
+    if (grid > 0) {
+        cpu_log = false;
+        run_grid(renderer, &launcher, grid);
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        launcher_free(&launcher);
+        return 0;
+    }
 
+    // 屏幕缓冲区 (RGBA格式)，按最大的 4 倍放大留够位置
+    static uint32_t pixels[64 * 4 * 32 * 4];
     Chip8 cpu;
-    init_cpu(&cpu);
-    if (!load_rom(&cpu, argv[1])) { printf("Failed to load ROM\n"); return 1; }
+    launcher_switch(&launcher, &cpu, 0);
+
+    if (net_player != 0) {
+        // 联机：两边必须从一模一样的状态出发，随机数种子也要一样
+        static NetSession ns;
+        if (!net_open(&ns, net_player, net_port, net_peer)) {
+            printf("Error: cannot open UDP port %d / peer %s\n", net_port, net_peer);
+        } else {
+            ns.delay_ms = net_delay;
+            ns.loss_pct = net_loss;
+            cpu.rng = seed;
+            cpu_log = false; // 回滚重跑的时候不要重复打印
+            printf("Netplay: player %d, port %d, peer %s (delay %d ms, loss %d%%)\n",
+                   net_player, net_port, net_peer, net_delay, net_loss);
+            run_netplay(renderer, texture, &cpu, filter, pixels, &ns);
+        }
+        launcher_free(&launcher);
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 0;
+    }
+    for (int i = 0; i < nwatches; ++i) watch_prime(&watches[i], &cpu);
+    bool paused = false; // 条件断点命中后暂停，按 P 继续
+    static RamSearch search; // F1 开始 RAM 搜索，F2~F5 过滤，F6 列出候选
+    ram_search_start(&search, &cpu);
+    if (launcher.count > 1) {
+        printf("Launcher: %d ROMs loaded, PageUp/PageDown to switch\n", launcher.count);
+    }
+
+    // 监视 ROM 文件，改完保存后自动重载 (窗口和渲染器都不用重建)
+    RomWatcher watcher;
+    if (!rom_watch_init(&watcher, launcher.slots[0].path)) {
+        printf("Warning: hot reload disabled (inotify unavailable)\n");
+    }
 
-    // 屏幕缓冲区 (RGBA格式)
-    uint32_t pixels[64 * 32]; 
+    static Audio audio;
+    if (audio_on && !audio_open(&audio)) {
+        printf("Warning: no audio device (%s), audio disabled\n", SDL_GetError());
+        audio_on = audio_sync = false;
+    }
+
+    // 撤销日志：F7 后退一条，F8 前进一条，F9 反向继续到断点
+    static Journal journal;
+    bool journal_on = journal_steps > 0 && journal_open(&journal, journal_steps);
+    if (journal_steps > 0 && !journal_on) {
+        printf("Warning: cannot allocate undo journal, step back disabled\n");
+    } else if (journal_on) {
+        printf("Journal: last %d instructions, F7 step back, F8 step, F9 reverse-continue\n",
+               (int)journal.step_mask + 1);
+    }
+
+    // JIT：有监视表达式或者记日志的时候要一条一条跑，不能整块跑
+    static Jit jit;
+    if (jit_on && nwatches > 0) {
+        printf("Warning: --jit ignored while watches are set\n");
+    } else if (jit_on && journal_on) {
+        printf("Warning: --jit ignored while journaling\n");
+    } else if (jit_on && !jit_open(&jit)) {
+        printf("Warning: cannot start JIT, running interpreter only\n");
+    } else if (jit_on) {
+        cpu_jit = &jit;
+        cpu_log = false; // 编译好的块不会打印，干脆都不打印
+    }
+
+    // 采样分析器：1kHz，退出时打印
+    static Profiler profiler;
+    prof_cpu = &cpu;
+    if (prof_on && !prof_start(&profiler, 1000)) {
+        printf("Warning: cannot start profiler\n");
+    }
+
+    int frames_since_boundary = 30; // 多少批没见到帧边界了 (先假设没有)
+    int boundary_interval = 0;      // 最近两个帧边界隔了几批，0 表示没有规律
     int running = 1;
     SDL_Event event;
 
     // === 主循环 ===
     while (running) {
         // 1. 模拟 CPU 周期 (每帧跑 10 个指令，加速绘制过程)
-        for (int i = 0; i < 10; i++) {
-            emulate_cycle(&cpu);
+        // 开了声音，跑几帧由声卡缓冲的水位决定；否则每次循环跑一帧
+        int frames = audio_on ? audio_frames_wanted(&audio, audio_sync ? 4 : 1) : 1;
+        for (int f = 0; f < frames; ++f) {
+            // ROM 一画完一帧 (见 mark_frame_boundary) 就马上显示，不等这一批跑完，
+            // 这样既不会显示画了一半的画面，也少了一截延迟
+            // 有监视表达式的时候一条一条跑，每条指令后都要检查
+            int budget = paused ? 0 : 10;
+            while (budget > 0) {
+                int n = nwatches > 0 ? 1 : budget;
+                budget -= journal_on ? journal_run(&journal, &cpu, n, true) : run_cycles_until(&cpu, n, true);
+                if (nwatches > 0 && check_watches(watches, nwatches, &cpu)) {
+                    paused = true;
+                    budget = 0;
+                    cpu.draw_flag = true; // 停下来的时候把当前画面显示出来
+                    printf("Paused, press P to continue\n");
+                }
+                if (cpu.frame_ready) {
+                    cpu.frame_ready = false;
+                    cpu.draw_flag = false;
+                    // 两个帧边界之间隔了几批；隔得太久 (比如只在发球时等一下的 Pong) 就不算有节奏
+                    boundary_interval = (frames_since_boundary < 30) ? frames_since_boundary + 1 : 0;
+                    frames_since_boundary = 0;
+                    present_frame(renderer, texture, &cpu, filter, pixels);
+                }
+            }
+            if (audio_on) audio_produce(&audio, get_sound_timer(&cpu) > 0);
+            // 后面还要接着补帧，这一帧画的东西显示不出来了
+            if (f + 1 < frames && cpu.draw_flag) audio.coalesced++;
         }
 
         // 2. 处理退出事件和键盘输入
+        prof_phase = PROF_SDL;
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_QUIT) running = 0;
             
+            // P：暂停/继续
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_p) {
+                paused = !paused;
+                continue;
+            }
+
+            // RAM 搜索的热键
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym >= SDLK_F1 && event.key.keysym.sym <= SDLK_F6) {
+                switch (event.key.keysym.sym) {
+                    case SDLK_F1: ram_search_start(&search, &cpu); break;
+                    case SDLK_F2: ram_search_filter(&search, &cpu, SEARCH_CHANGED, 0); break;
+                    case SDLK_F3: ram_search_filter(&search, &cpu, SEARCH_UNCHANGED, 0); break;
+                    case SDLK_F4: ram_search_filter(&search, &cpu, SEARCH_INCREASED, 0); break;
+                    case SDLK_F5: ram_search_filter(&search, &cpu, SEARCH_DECREASED, 0); break;
+                    default: break;
+                }
+                ram_search_print(&search, event.key.keysym.sym == SDLK_F6 ? 64 : 8);
+                continue;
+            }
+
+            // 撤销日志的热键：先暂停，再一条一条地退/走
+            if (event.type == SDL_KEYDOWN && journal_on && event.key.keysym.sym >= SDLK_F7 &&
+                event.key.keysym.sym <= SDLK_F9) {
+                paused = true;
+                if (event.key.keysym.sym == SDLK_F7) {
+                    if (!journal_undo(&journal, &cpu)) printf("Journal empty\n");
+                } else if (event.key.keysym.sym == SDLK_F8) {
+                    journal_run(&journal, &cpu, 1, false);
+                    check_watches(watches, nwatches, &cpu);
+                } else {
+                    uint64_t n = journal_reverse_continue(&journal, &cpu, watches, nwatches);
+                    printf("Reversed %llu instructions\n", (unsigned long long)n);
+                }
+                // 退回去之后 changed() 要从新位置算起
+                for (int i = 0; i < nwatches; ++i) watch_prime(&watches[i], &cpu);
+                printf("pc=0x%03X I=0x%03X cycle=%llu  (journal depth %llu)\n", cpu.pc, cpu.I,
+                       (unsigned long long)cpu.cycles, (unsigned long long)journal_depth(&journal));
+                cpu.draw_flag = true;
+                continue;
+            }
+
+            // 启动器：PageUp/PageDown 换游戏
+            if (event.type == SDL_KEYDOWN && launcher.count > 1 &&
+                (event.key.keysym.sym == SDLK_PAGEUP || event.key.keysym.sym == SDLK_PAGEDOWN)) {
+                int step = (event.key.keysym.sym == SDLK_PAGEDOWN) ? 1 : -1;
+                launcher_switch(&launcher, &cpu, launcher.current + step);
+                if (journal_on) journal_clear(&journal); // 日志是上一个游戏的
+                SDL_SetWindowTitle(window, launcher.slots[launcher.current].path);
+                // 换成盯着新游戏的文件
+                rom_watch_close(&watcher);
+                rom_watch_init(&watcher, launcher.slots[launcher.current].path);
+                continue;
+            }
+
             // 键盘按下
             if (event.type == SDL_KEYDOWN) {
                 for (int i = 0; i < 16; ++i) {
@@ -505,27 +5660,38 @@ int main(int argc, char *argv[]) {
             }
         }
 
+        prof_phase = PROF_OTHER;
+
+        // 2.5 ROM 文件变了就重新加载 (每帧查一次，延迟最多一帧 ~16ms)
+        if (rom_watch_poll(&watcher)) {
+            hot_reload(&cpu, &launcher.slots[launcher.current]);
+            if (journal_on) journal_clear(&journal); // 内存换了，旧的日志退不回去
+        }
+
         // 3. 只有当 draw_flag 为 true 时才更新画面 (节省资源)
-        if (cpu.draw_flag) {
+        // 帧边界来得很规律的 ROM，只在边界上显示；
+        // 没有规律，或者下一个边界迟迟不来，就还按老办法每批显示一次
+        if (frames_since_boundary < 30) frames_since_boundary++;
+        bool paced = boundary_interval > 0 && frames_since_boundary < 2 * boundary_interval;
+        if (!paced && cpu.draw_flag) {
             cpu.draw_flag = false;
-            
-            for (int i = 0; i < 2048; ++i) {
-                uint8_t pixel = cpu.gfx[i];
-                // 像素为1 -> 白色(FFFFFFFF)，像素为0 -> 黑色(000000FF)
-                pixels[i] = (pixel == 1) ? 0xFFFFFFFF : 0x000000FF; 
-            }
-
-            SDL_UpdateTexture(texture, NULL, pixels, 64 * sizeof(uint32_t));
-            SDL_RenderClear(renderer);
-            SDL_RenderCopy(renderer, texture, NULL, NULL);
-            SDL_RenderPresent(renderer);
+            present_frame(renderer, texture, &cpu, filter, pixels);
         }
 
+        if (prof != NULL) prof_drain(prof);
+
         // 4. 控制帧率 (稍微休眠一下)
-        SDL_Delay(16); // 约 60FPS
+        // 开了声音只是歇一小会儿，节奏由声卡定
+        SDL_Delay(audio_on ? 2 : 16); // 约 60FPS
     }
 
     // 清理
+    if (audio_on) audio_close(&audio);
+    if (prof != NULL) prof_stop(prof, &cpu, 16);
+    if (cpu_jit != NULL) jit_close(cpu_jit);
+    if (journal_on) journal_close(&journal);
+    rom_watch_close(&watcher);
+    launcher_free(&launcher);
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
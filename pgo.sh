@@ -0,0 +1,76 @@
+#!/bin/sh
+# PGO 构建：插桩编译 -> 用无界面模式跑一遍 ROM 训练 -> 用收集到的数据 + LTO 重新编译，
+# 最后和普通的 -O2 比一比快了多少。
+#
+# 用法: ./pgo.sh [ROM 或 ROM 目录 ...]        (默认用仓库里的 *.ch8)
+# 环境变量: CC, SDL_CFLAGS / SDL_LIBS (默认用 sdl2-config), FRAMES (每个 ROM 跑多少帧), RUNS
+set -e
+cd "$(dirname "$0")"
+
+CC=${CC:-gcc}
+SDL_CFLAGS=${SDL_CFLAGS:-$(sdl2-config --cflags 2>/dev/null || echo "")}
+SDL_LIBS=${SDL_LIBS:-$(sdl2-config --libs 2>/dev/null || echo "-lSDL2")}
+LIBS="$SDL_LIBS -pthread -ldl -lm"
+FRAMES=${FRAMES:-200000}
+RUNS=${RUNS:-5}
+OUT=build-pgo
+mkdir -p "$OUT"
+rm -f "$OUT"/*.gcda
+
+if [ $# -eq 0 ]; then
+    set -- *.ch8
+fi
+
+# 训练用的按键脚本：帧号 按键掩码。Pong 的两个拍子上下来回动，再加上什么都不按的时候
+cat > "$OUT/train.keys" <<'EOF'
+# frame keys
+0     0000
+300   0002
+600   1000
+900   0012
+1200  2000
+1500  2010
+1800  0000
+EOF
+
+# 插桩版和最终版的输出文件名要一样，gcc 才能对上 .gcda 的名字
+echo "== 1. instrumented build"
+$CC -O2 -fprofile-generate -fprofile-update=atomic -fprofile-dir="$OUT" $SDL_CFLAGS main.c -o "$OUT/chip8" $LIBS
+mv "$OUT/chip8" "$OUT/chip8-gen"
+
+echo "== 2. training run"
+for rom in "$@"; do
+    echo "   $rom"
+    "$OUT/chip8-gen" --headless "$FRAMES" --input "$OUT/train.keys" "$rom" >/dev/null
+    "$OUT/chip8-gen" --headless "$FRAMES" --seed 7 "$rom" >/dev/null
+done
+
+echo "== 3. optimized builds"
+$CC -O2 -fprofile-use -fprofile-correction -fprofile-dir="$OUT" -flto $SDL_CFLAGS main.c -o "$OUT/chip8" $LIBS
+mv "$OUT/chip8" "$OUT/chip8-pgo"
+$CC -O2 $SDL_CFLAGS main.c -o "$OUT/chip8-o2" $LIBS
+
+# 跑 RUNS 次取最快的一次，单位 ms。参数: 程序 ROM...
+bench() {
+    bin=$1
+    shift
+    best=""
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        total=0
+        for rom in "$@"; do
+            ms=$("$bin" --headless "$FRAMES" --input "$OUT/train.keys" "$rom" | awk '/^Headless total:/ { print $(NF-4) }')
+            total=$(awk "BEGIN { print $total + $ms }")
+        done
+        if [ -z "$best" ] || awk "BEGIN { exit !($total < $best) }"; then best=$total; fi
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+echo "== 4. benchmark ($FRAMES frames per ROM, best of $RUNS)"
+o2=$(bench "$OUT/chip8-o2" "$@")
+pgo=$(bench "$OUT/chip8-pgo" "$@")
+echo "   -O2:             $o2 ms"
+echo "   -O2 + PGO + LTO: $pgo ms"
+awk "BEGIN { printf \"   gain: %.1f%%\\n\", ($o2 - $pgo) * 100.0 / $o2 }"
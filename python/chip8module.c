@@ -0,0 +1,395 @@
+// Python 绑定：import chip8
+//
+//   import chip8, numpy as np
+//   c = chip8.Chip8(open("Pong.ch8", "rb").read(), seed=1)
+//   c.step(60, keys=0x0002)          // 跑 60 帧，按着 1 号键
+//   screen = np.asarray(c.framebuffer) // (32, 64) 的 uint8，不拷贝，直接就是模拟器里的 gfx
+//   ram = np.asarray(c.memory)         // 4096 字节，同上，但是只读 (见 get_memory)
+//   s = c.snapshot(); c.restore(s)
+//   chip8.step_all([c1, c2, ...], 60)  // 一批实例一起跑
+//
+// 跑的时候会释放 GIL，多个 Python 线程可以同时跑不同的实例。
+// 模拟器核心就是 main.c 本身 (它的 main 改个名字，不会被调用)。
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#define main chip8_cli_main
+#include "../main.c"
+#undef main
+
+typedef struct {
+    PyObject_HEAD
+    Chip8 cpu;
+    bool busy;     // 正在别的线程里跑 (没有 GIL 保护了)，这时不许碰
+    bool restored; // 状态是从外面给的字节恢复的，只能跑加固核心 (见 chip8_restore)
+} Chip8Object;
+
+// framebuffer / memory / V 返回的视图对象：只实现缓冲区协议，指向 Chip8Object 里面的数组
+typedef struct {
+    PyObject_HEAD
+    Chip8Object *owner;
+    uint8_t *data;
+    bool readonly;
+    int ndim;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} Chip8View;
+
+static PyTypeObject Chip8Type;
+static PyTypeObject Chip8ViewType;
+
+static bool check_idle(Chip8Object *self) {
+    if (self->busy) {
+        PyErr_SetString(PyExc_RuntimeError, "instance is being stepped by another thread");
+        return false;
+    }
+    return true;
+}
+
+// === 视图 ===
+static int view_getbuffer(PyObject *obj, Py_buffer *view, int flags) {
+    Chip8View *v = (Chip8View *)obj;
+    if (v->readonly && (flags & PyBUF_WRITABLE)) {
+        PyErr_SetString(PyExc_BufferError, "view is read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    Py_ssize_t len = v->shape[0] * (v->ndim == 2 ? v->shape[1] : 1);
+    view->obj = obj;
+    Py_INCREF(obj);
+    view->buf = v->data;
+    view->len = len;
+    view->itemsize = 1;
+    view->readonly = v->readonly;
+    view->format = (flags & PyBUF_FORMAT) ? "B" : NULL;
+    view->ndim = v->ndim;
+    view->shape = (flags & PyBUF_ND) ? v->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? v->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static void view_dealloc(Chip8View *v) {
+    Py_XDECREF(v->owner);
+    Py_TYPE(v)->tp_free((PyObject *)v);
+}
+
+static PyBufferProcs view_as_buffer = { view_getbuffer, NULL };
+
+static PyTypeObject Chip8ViewType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "chip8.View",
+    .tp_basicsize = sizeof(Chip8View),
+    .tp_dealloc = (destructor)view_dealloc,
+    .tp_as_buffer = &view_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Zero-copy buffer over part of a Chip8 instance",
+};
+
+// 返回 memoryview(View)，numpy.asarray 可以直接用
+static PyObject *make_view(Chip8Object *owner, uint8_t *data, Py_ssize_t rows, Py_ssize_t cols, bool readonly) {
+    Chip8View *v = PyObject_New(Chip8View, &Chip8ViewType);
+    if (v == NULL) return NULL;
+    Py_INCREF(owner);
+    v->owner = owner;
+    v->data = data;
+    v->readonly = readonly;
+    v->ndim = cols > 0 ? 2 : 1;
+    v->shape[0] = rows;
+    v->shape[1] = cols;
+    v->strides[0] = cols > 0 ? cols : 1;
+    v->strides[1] = 1;
+    PyObject *mv = PyMemoryView_FromObject((PyObject *)v);
+    Py_DECREF(v);
+    return mv;
+}
+
+// === Chip8 ===
+static bool load_bytes(Chip8Object *self, Py_buffer *rom) {
+    uint32_t rng = self->cpu.rng;
+    init_cpu(&self->cpu);
+    self->cpu.rng = rng;
+    self->restored = false;
+    if (rom->len > 4096 - 512 || !load_rom_bytes(&self->cpu, rom->buf, (long)rom->len)) {
+        PyErr_SetString(PyExc_ValueError, "ROM is too big");
+        return false;
+    }
+    return true;
+}
+
+static int chip8_init(Chip8Object *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = { "rom", "seed", NULL };
+    Py_buffer rom = { 0 };
+    unsigned long seed = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|y*k", kwlist, &rom, &seed)) return -1;
+    init_cpu(&self->cpu);
+    self->restored = false;
+    if (seed != 0) self->cpu.rng = (uint32_t)seed | 1;
+    bool ok = rom.buf == NULL || load_bytes(self, &rom);
+    if (rom.buf != NULL) PyBuffer_Release(&rom);
+    return ok ? 0 : -1;
+}
+
+static PyObject *chip8_load(Chip8Object *self, PyObject *arg) {
+    Py_buffer rom;
+    if (!check_idle(self) || PyObject_GetBuffer(arg, &rom, PyBUF_SIMPLE) != 0) return NULL;
+    bool ok = load_bytes(self, &rom);
+    PyBuffer_Release(&rom);
+    if (!ok) return NULL;
+    Py_RETURN_NONE;
+}
+
+static void set_keys(Chip8 *cpu, unsigned long keys) {
+    for (int k = 0; k < 16; ++k) cpu->key[k] = (keys >> k) & 1;
+}
+
+static void step_frames(Chip8 *cpu, unsigned long frames) {
+    for (unsigned long f = 0; f < frames; ++f) {
+        run_cycles(cpu, HEADLESS_CYCLES_PER_FRAME);
+    }
+    cpu->frame_ready = false;
+    cpu->draw_flag = false;
+}
+
+static PyObject *chip8_step(Chip8Object *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = { "frames", "keys", NULL };
+    unsigned long frames = 1;
+    PyObject *keys = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|kO", kwlist, &frames, &keys)) return NULL;
+    if (!check_idle(self)) return NULL;
+    if (keys != Py_None) {
+        unsigned long mask = PyLong_AsUnsignedLong(keys);
+        if (PyErr_Occurred()) return NULL;
+        set_keys(&self->cpu, mask);
+    }
+    self->busy = true;
+    Py_BEGIN_ALLOW_THREADS
+    step_frames(&self->cpu, frames);
+    Py_END_ALLOW_THREADS
+    self->busy = false;
+    return PyLong_FromUnsignedLongLong(self->cpu.cycles);
+}
+
+static PyObject *chip8_set_keys(Chip8Object *self, PyObject *arg) {
+    unsigned long mask = PyLong_AsUnsignedLong(arg);
+    if (PyErr_Occurred() || !check_idle(self)) return NULL;
+    set_keys(&self->cpu, mask);
+    Py_RETURN_NONE;
+}
+
+static PyObject *chip8_snapshot(Chip8Object *self, PyObject *unused) {
+    (void)unused;
+    if (!check_idle(self)) return NULL;
+    return PyBytes_FromStringAndSize((const char *)&self->cpu, sizeof(Chip8));
+}
+
+static PyObject *chip8_restore(Chip8Object *self, PyObject *arg) {
+    Py_buffer snap;
+    if (!check_idle(self) || PyObject_GetBuffer(arg, &snap, PyBUF_SIMPLE) != 0) return NULL;
+    if (snap.len != (Py_ssize_t)sizeof(Chip8)) {
+        PyBuffer_Release(&snap);
+        PyErr_SetString(PyExc_ValueError, "not a snapshot of this build");
+        return NULL;
+    }
+    // 字节是外面给的，可能是随便改过的：先检查核心自己依赖的那几个下标，
+    // 再一律放到加固核心上跑 (安全检查只证明了从 0x200 开机跑是安全的，证明不了任意的 pc/栈)。
+    // I 越界不用管，加固核心每次访存都会检查
+    Chip8 cpu;
+    memcpy(&cpu, snap.buf, sizeof(Chip8));
+    PyBuffer_Release(&snap);
+    bool ok = cpu.sp <= 16 && cpu.pc < 4096 && cpu.display_count >= 0 && cpu.display_count <= DISPLAY_LIST_SIZE &&
+              cpu.fault < sizeof(fault_names) / sizeof(fault_names[0]) && cpu.quirks < (1u << QUIRK_COUNT);
+    for (int i = 0; ok && i < cpu.display_count; ++i) ok = cpu.display_list[i].height <= 15;
+    if (!ok) {
+        PyErr_SetString(PyExc_ValueError, "corrupt snapshot");
+        return NULL;
+    }
+    cpu.hardened = true;
+    cpu.cycle_limit = 0;
+    // 原地拷贝，已经拿出去的 framebuffer/memory 视图还是有效的
+    self->cpu = cpu;
+    self->restored = true;
+    Py_RETURN_NONE;
+}
+
+static PyObject *chip8_state_hash(Chip8Object *self, PyObject *unused) {
+    (void)unused;
+    return PyLong_FromUnsignedLong(cpu_state_hash(&self->cpu));
+}
+
+static PyObject *get_framebuffer(Chip8Object *self, void *closure) {
+    (void)closure;
+    return make_view(self, self->cpu.gfx, 32, 64, false);
+}
+
+// 内存是只读的：快速核心靠的是加载时的安全检查，从外面改了代码，检查的结论就不作数了
+static PyObject *get_memory(Chip8Object *self, void *closure) {
+    (void)closure;
+    return make_view(self, self->cpu.memory, 4096, 0, true);
+}
+
+static PyObject *get_registers(Chip8Object *self, void *closure) {
+    (void)closure;
+    return make_view(self, self->cpu.V, 16, 0, false);
+}
+
+static PyObject *get_pc(Chip8Object *self, void *closure) {
+    (void)closure;
+    return PyLong_FromLong(self->cpu.pc);
+}
+
+static PyObject *get_i(Chip8Object *self, void *closure) {
+    (void)closure;
+    return PyLong_FromLong(self->cpu.I);
+}
+
+static PyObject *get_cycles(Chip8Object *self, void *closure) {
+    (void)closure;
+    return PyLong_FromUnsignedLongLong(self->cpu.cycles);
+}
+
+static PyObject *get_fault(Chip8Object *self, void *closure) {
+    (void)closure;
+    if (self->cpu.fault == 0) Py_RETURN_NONE;
+    return PyUnicode_FromString(fault_names[self->cpu.fault]);
+}
+
+static PyObject *get_quirks(Chip8Object *self, void *closure) {
+    (void)closure;
+    return PyLong_FromLong(self->cpu.quirks);
+}
+
+// 换了怪癖，安全检查的结论可能也变了 (见 cpu_verify)
+static int set_quirks(Chip8Object *self, PyObject *value, void *closure) {
+    (void)closure;
+    if (value == NULL) {
+        PyErr_SetString(PyExc_TypeError, "cannot delete quirks");
+        return -1;
+    }
+    unsigned long q = PyLong_AsUnsignedLong(value);
+    if (PyErr_Occurred() || !check_idle(self)) return -1;
+    if (q >= (1u << QUIRK_COUNT)) {
+        PyErr_SetString(PyExc_ValueError, "unknown quirk bits");
+        return -1;
+    }
+    self->cpu.quirks = (uint8_t)q;
+    cpu_verify(&self->cpu);
+    if (self->restored) self->cpu.hardened = true;
+    return 0;
+}
+
+static PyMethodDef chip8_methods[] = {
+    { "load", (PyCFunction)chip8_load, METH_O, "load(rom): power-cycle and load ROM bytes" },
+    { "step", (PyCFunction)(void (*)(void))chip8_step, METH_VARARGS | METH_KEYWORDS,
+      "step(frames=1, keys=None) -> cycles: run frames (10 cycles each) without the GIL" },
+    { "set_keys", (PyCFunction)chip8_set_keys, METH_O, "set_keys(mask): bit i = key i" },
+    { "snapshot", (PyCFunction)chip8_snapshot, METH_NOARGS, "snapshot() -> bytes" },
+    { "restore", (PyCFunction)chip8_restore, METH_O, "restore(snapshot): restored state always runs on the hardened core" },
+    { "state_hash", (PyCFunction)chip8_state_hash, METH_NOARGS, "state_hash() -> int" },
+    { NULL, NULL, 0, NULL },
+};
+
+static PyGetSetDef chip8_getset[] = {
+    { "framebuffer", (getter)get_framebuffer, NULL, "(32, 64) uint8 view of the screen, no copy", NULL },
+    { "memory", (getter)get_memory, NULL, "4096-byte read-only view of RAM, no copy", NULL },
+    { "V", (getter)get_registers, NULL, "16-byte view of V0..VF, no copy", NULL },
+    { "pc", (getter)get_pc, NULL, NULL, NULL },
+    { "I", (getter)get_i, NULL, NULL, NULL },
+    { "cycles", (getter)get_cycles, NULL, NULL, NULL },
+    { "fault", (getter)get_fault, NULL, "hardened-core fault name, or None", NULL },
+    { "quirks", (getter)get_quirks, (setter)set_quirks, "QUIRK_xxx bits (1 shift, 2 load_store, 4 vf_reset, 8 jump, 16 edge)", NULL },
+    { NULL, NULL, NULL, NULL, NULL },
+};
+
+static PyTypeObject Chip8Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "chip8.Chip8",
+    .tp_basicsize = sizeof(Chip8Object),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Chip8(rom=None, seed=0): one emulator instance",
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)chip8_init,
+    .tp_methods = chip8_methods,
+    .tp_getset = chip8_getset,
+};
+
+// step_all(instances, frames, keys=None)：一批实例一起跑，中间不拿 GIL
+static PyObject *chip8_step_all(PyObject *module, PyObject *args, PyObject *kwds) {
+    (void)module;
+    static char *kwlist[] = { "instances", "frames", "keys", NULL };
+    PyObject *list, *keys = Py_None;
+    unsigned long frames = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|kO", kwlist, &list, &frames, &keys)) return NULL;
+    PyObject *seq = PySequence_Fast(list, "instances must be a sequence");
+    if (seq == NULL) return NULL;
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    PyObject **items = PySequence_Fast_ITEMS(seq);
+    if (keys != Py_None && (!PySequence_Check(keys) || PySequence_Size(keys) != n)) {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "keys must be a sequence with one mask per instance");
+        return NULL;
+    }
+    Chip8 **cpus = PyMem_Malloc((n ? n : 1) * sizeof(Chip8 *));
+    if (cpus == NULL) {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+
+    Py_ssize_t i = 0;
+    for (; i < n; ++i) {
+        if (!PyObject_TypeCheck(items[i], &Chip8Type)) {
+            PyErr_SetString(PyExc_TypeError, "instances must be chip8.Chip8 objects");
+            break;
+        }
+        Chip8Object *c = (Chip8Object *)items[i];
+        if (!check_idle(c)) break;
+        if (keys != Py_None) {
+            PyObject *k = PySequence_GetItem(keys, i);
+            unsigned long mask = k ? PyLong_AsUnsignedLong(k) : 0;
+            Py_XDECREF(k);
+            if (PyErr_Occurred()) break;
+            set_keys(&c->cpu, mask);
+        }
+        c->busy = true; // 同一个实例在列表里出现两次也会被挡住
+        cpus[i] = &c->cpu;
+    }
+    if (i == n) {
+        Py_BEGIN_ALLOW_THREADS
+        for (Py_ssize_t j = 0; j < n; ++j) step_frames(cpus[j], frames);
+        Py_END_ALLOW_THREADS
+    }
+    for (Py_ssize_t j = 0; j < i; ++j) ((Chip8Object *)items[j])->busy = false;
+    PyMem_Free(cpus);
+    Py_DECREF(seq);
+    if (i != n) return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef module_methods[] = {
+    { "step_all", (PyCFunction)(void (*)(void))chip8_step_all, METH_VARARGS | METH_KEYWORDS,
+      "step_all(instances, frames=1, keys=None): step many instances in one call without the GIL" },
+    { NULL, NULL, 0, NULL },
+};
+
+static struct PyModuleDef chip8_module = {
+    PyModuleDef_HEAD_INIT, "chip8", "CHIP-8 emulator core", -1, module_methods,
+    NULL, NULL, NULL, NULL,
+};
+
+PyMODINIT_FUNC PyInit_chip8(void) {
+    // 脚本里一次跑成千上万帧，不要打印
+    cpu_log = false;
+    rom_log = false;
+    if (PyType_Ready(&Chip8Type) < 0 || PyType_Ready(&Chip8ViewType) < 0) return NULL;
+    PyObject *m = PyModule_Create(&chip8_module);
+    if (m == NULL) return NULL;
+    Py_INCREF(&Chip8Type);
+    if (PyModule_AddObject(m, "Chip8", (PyObject *)&Chip8Type) < 0) {
+        Py_DECREF(&Chip8Type);
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,34 @@
+# 编译 Python 绑定：cd python && python3 setup.py build_ext --inplace
+# SDL 的编译参数默认用 sdl2-config，也可以用环境变量 SDL_CFLAGS / SDL_LIBS 指定 (和 pgo.sh 一样)
+import os
+import shlex
+import subprocess
+
+from setuptools import Extension, setup
+
+
+def sdl_flags(var, arg, default):
+    if var in os.environ:
+        return shlex.split(os.environ[var])
+    try:
+        return shlex.split(subprocess.check_output(["sdl2-config", arg], text=True))
+    except (OSError, subprocess.CalledProcessError):
+        return default
+
+
+cflags = sdl_flags("SDL_CFLAGS", "--cflags", [])
+libs = sdl_flags("SDL_LIBS", "--libs", ["-lSDL2"])
+
+setup(
+    name="chip8",
+    version="0.1",
+    ext_modules=[
+        Extension(
+            "chip8",
+            sources=["chip8module.c"],
+            depends=["../main.c"],
+            extra_compile_args=["-O2"] + cflags,
+            extra_link_args=libs + ["-pthread", "-ldl", "-lm"],
+        )
+    ],
+)